@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include "checksum.h"
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+// CRC32C (Castagnoli) polynomial, bit reversed
+#define CRC32C_POLY 0x82f63b78
+
+static uint32_t crc32c_table[256];
+
+/**
+ * Build the lookup table for the software implementation,
+ * must be called once before crc32c_update
+ */
+void crc32c_init() {
+  uint32_t n;
+  for (n = 0; n < 256; n++) {
+    uint32_t crc = n;
+    int k;
+    for (k = 0; k < 8; k++) {
+      crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    }
+    crc32c_table[n] = crc;
+  }
+}
+
+/**
+ * Continue a CRC32C over the next part of the data; start with crc = 0
+ *
+ * Uses the SSE4.2 crc32 instruction when compiled for it (-march=native)
+ *
+ * @param {uint32_t} crc Checksum of the preceding data
+ * @param {const char *} buffer Data
+ * @param {size_t} length Length of the data in bytes
+ * @returns {uint32_t} Checksum of the preceding data followed by buffer
+ */
+uint32_t crc32c_update(uint32_t crc, const char *buffer, size_t length) {
+  const unsigned char *next = (const unsigned char *) buffer;
+  crc = ~crc;
+
+#ifdef __SSE4_2__
+  uint64_t crc64 = crc;
+  while (length >= 8) {
+    uint64_t word;
+    __builtin_memcpy(&word, next, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+    next += 8;
+    length -= 8;
+  }
+  crc = (uint32_t) crc64;
+  while (length--) {
+    crc = _mm_crc32_u8(crc, *next++);
+  }
+#else
+  while (length--) {
+    crc = (crc >> 8) ^ crc32c_table[(crc ^ *next++) & 0xff];
+  }
+#endif
+
+  return ~crc;
+}
+
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while (vec) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+  int n;
+  for (n = 0; n < 32; n++) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+
+/**
+ * Combine the checksums of two consecutive blocks of data,
+ * this allows checksumming blocks in parallel and out of order
+ *
+ * Algorithm from zlib's crc32_combine, by Mark Adler
+ *
+ * @param {uint32_t} crc1 Checksum of the first block
+ * @param {uint32_t} crc2 Checksum of the second block
+ * @param {size_t} length2 Length of the second block in bytes
+ * @returns {uint32_t} Checksum of the first block followed by the second block
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t length2) {
+  uint32_t even[32]; // even-power-of-two zeros operator
+  uint32_t odd[32];  // odd-power-of-two zeros operator
+
+  if (length2 == 0) {
+    return crc1;
+  }
+
+  // operator for one zero bit in odd
+  odd[0] = CRC32C_POLY;
+  uint32_t row = 1;
+  int n;
+  for (n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+
+  // operator for two zero bits in even, four zero bits in odd
+  gf2_matrix_square(even, odd);
+  gf2_matrix_square(odd, even);
+
+  // apply length2 zero bytes to crc1 (first square will put the operator for one zero byte, eight zero bits, in even)
+  do {
+    gf2_matrix_square(even, odd);
+    if (length2 & 1) {
+      crc1 = gf2_matrix_times(even, crc1);
+    }
+    length2 >>= 1;
+    if (length2 == 0) {
+      break;
+    }
+
+    gf2_matrix_square(odd, even);
+    if (length2 & 1) {
+      crc1 = gf2_matrix_times(odd, crc1);
+    }
+    length2 >>= 1;
+  } while (length2 != 0);
+
+  return crc1 ^ crc2;
+}
+
+/**
+ * Build the operator appending length zero bytes; the operator is linear, so its columns are the shifted unit vectors
+ */
+static void zeros_build(crc32c_zeros_t *zeros, size_t length) {
+  int n;
+  for (n = 0; n < 32; n++) {
+    zeros->matrix[n] = crc32c_combine(1u << n, 0, length);
+  }
+  zeros->length = length;
+}
+
+/**
+ * Same as crc32c_combine, but reuses the zeros operator for length2 from the previous call;
+ * combining many blocks of the same length then costs a single matrix times vector each
+ *
+ * @param {crc32c_zeros_t *} zeros Operator, rebuilt when length2 differs from the previous call
+ * @param {uint32_t} crc1 Checksum of the first block
+ * @param {uint32_t} crc2 Checksum of the second block
+ * @param {size_t} length2 Length of the second block in bytes
+ * @returns {uint32_t} Checksum of the first block followed by the second block
+ */
+uint32_t crc32c_combine_zeros(crc32c_zeros_t *zeros, uint32_t crc1, uint32_t crc2, size_t length2) {
+  if (length2 == 0) {
+    return crc1;
+  }
+
+  if (zeros->length != length2) {
+    zeros_build(zeros, length2);
+  }
+
+  return gf2_matrix_times(zeros->matrix, crc1) ^ crc2;
+}
+
+/**
+ * Build the operators for rows of nstripes * stripe_size bytes
+ *
+ * @param {crc32c_stripes_t *} stripes Operators, free with crc32c_stripes_free
+ * @param {int} nstripes Number of stripes per row
+ * @param {size_t} stripe_size Bytes per row of a stripe
+ */
+void crc32c_stripes_init(crc32c_stripes_t *stripes, int nstripes, size_t stripe_size) {
+  stripes->nstripes = nstripes;
+  stripes->stripe_size = stripe_size;
+  zeros_build(&stripes->gap, (nstripes - 1) * stripe_size);
+
+  stripes->tail = malloc(nstripes * sizeof(crc32c_zeros_t));
+  int stripe;
+  for (stripe = 0; stripe < nstripes; stripe++) {
+    zeros_build(&stripes->tail[stripe], (nstripes - 1 - stripe) * stripe_size);
+  }
+}
+
+void crc32c_stripes_free(crc32c_stripes_t *stripes) {
+  free(stripes->tail);
+  stripes->tail = NULL;
+}
+
+/**
+ * Checksum contribution of a single stripe of columns to a block of rows,
+ * the CRC32C of the whole block is the XOR of the contributions of all stripes.
+ *
+ * This allows checksumming every stripe directly after it is filled, while it is still in cache,
+ * instead of reading the full rows again. The other stripes count as zero bytes, which are skipped
+ * with the precomputed operators; this relies on the checksum being linear in the data.
+ * The initial value of the checksum is carried by the first stripe.
+ *
+ * @param {const crc32c_stripes_t *} stripes Operators, only read so they can be shared between threads
+ * @param {int} stripe Index of the stripe in the row
+ * @param {const char *} buffer Start of the stripe in the first row, rows are nstripes * stripe_size bytes apart
+ * @param {int} nrows Number of rows in the block
+ * @returns {uint32_t} Contribution of the stripe to the checksum of the block
+ */
+uint32_t crc32c_stripe(const crc32c_stripes_t *stripes, int stripe, const char *buffer, int nrows) {
+  const size_t row_size = stripes->nstripes * stripes->stripe_size;
+
+  // raw (unconditioned) register, with the zero bytes before the stripe in the first row it stays zero
+  uint32_t crc = stripe == 0 ? 0xffffffff : 0;
+  int row;
+  for (row = 0; row < nrows; row++) {
+    if (row) {
+      crc = gf2_matrix_times(stripes->gap.matrix, crc);
+    }
+    crc = ~crc32c_update(~crc, &buffer[row * row_size], stripes->stripe_size);
+  }
+  crc = gf2_matrix_times(stripes->tail[stripe].matrix, crc);
+
+  return stripe == 0 ? ~crc : crc;
+}
@@ -0,0 +1,30 @@
+#ifndef __HAVE_CHECKSUM_H__
+#define __HAVE_CHECKSUM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+extern void crc32c_init();
+extern uint32_t crc32c_update(uint32_t crc, const char *buffer, size_t length);
+extern uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t length2);
+
+// Operator appending a fixed number of zero bytes to a checksum, zero initialize before first use
+typedef struct {
+  size_t length;
+  uint32_t matrix[32];
+} crc32c_zeros_t;
+
+extern uint32_t crc32c_combine_zeros(crc32c_zeros_t *zeros, uint32_t crc1, uint32_t crc2, size_t length2);
+
+// Operators to checksum rows that are filled in stripes of columns, see crc32c_stripe
+typedef struct {
+  int nstripes;
+  size_t stripe_size;    // bytes per row of a stripe
+  crc32c_zeros_t gap;    // zero bytes between consecutive rows of a stripe
+  crc32c_zeros_t *tail;  // [nstripes] zero bytes after the last row of a stripe
+} crc32c_stripes_t;
+
+extern void crc32c_stripes_init(crc32c_stripes_t *stripes, int nstripes, size_t stripe_size);
+extern void crc32c_stripes_free(crc32c_stripes_t *stripes);
+extern uint32_t crc32c_stripe(const crc32c_stripes_t *stripes, int stripe, const char *buffer, int nrows);
+#endif
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "log.h"
+
+// Must be a power of two; total memory use is LOG_RING_SIZE * LOG_MESSAGE_SIZE
+#define LOG_RING_SIZE 1024
+#define LOG_MESSAGE_SIZE 256
+
+// Interval in ns at which the writer thread polls the ring when it is idle
+#define LOG_POLL_INTERVAL 50000000
+
+typedef struct {
+  atomic_size_t sequence;
+  char text[LOG_MESSAGE_SIZE];
+} log_entry_t;
+
+static log_entry_t ring[LOG_RING_SIZE];
+static atomic_size_t enqueue_pos = 0;
+static size_t dequeue_pos = 0; // only touched by the writer thread
+static atomic_ulong dropped = 0;
+
+static atomic_int log_level = LOG_LEVEL_INFO;
+static atomic_int stopping = 0;
+static int running = 0;
+static pthread_t writer;
+
+// Rate limited call sites, a lock-free list that is only ever prepended to
+static _Atomic(log_ratelimit_t *) ratelimits = NULL;
+
+static FILE *runlog = NULL;
+static int runlog_fd = -1;
+
+/**
+ * Bounded multi-producer queue after D. Vyukov: every slot carries a sequence number
+ * telling producers and the consumer whose turn it is.
+ * Sequence numbers are stored relative to the slot index, so the zero initialized ring is valid.
+ */
+static size_t get_sequence(size_t slot) {
+  return atomic_load_explicit(&ring[slot].sequence, memory_order_acquire) + slot;
+}
+
+static void set_sequence(size_t slot, size_t sequence) {
+  atomic_store_explicit(&ring[slot].sequence, sequence - slot, memory_order_release);
+}
+
+static size_t ring_claim() {
+  size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+  for (;;) {
+    intptr_t diff = (intptr_t) get_sequence(pos & (LOG_RING_SIZE - 1)) - (intptr_t) pos;
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+        return pos;
+      }
+    } else if (diff < 0) {
+      // ring is full
+      return SIZE_MAX;
+    } else {
+      pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * Write out all pending messages, returns the number of messages written
+ */
+static int ring_drain() {
+  int count = 0;
+
+  // once a second, report messages suppressed by rate limits, also when the call site has gone quiet
+  static long reported = 0;
+  long now = (long) time(NULL);
+  if (now != reported || atomic_load(&stopping)) {
+    reported = now;
+    log_ratelimit_t *limit;
+    for (limit = atomic_load(&ratelimits); limit; limit = limit->next) {
+      int suppressed = atomic_exchange(&limit->suppressed, 0);
+      if (suppressed) {
+        log_printf(LOG_LEVEL_WARN, "%s:%i: %i messages suppressed\n", limit->file, limit->line, suppressed);
+      }
+    }
+  }
+
+  for (;;) {
+    size_t slot = dequeue_pos & (LOG_RING_SIZE - 1);
+    if (get_sequence(slot) != dequeue_pos + 1) {
+      break;
+    }
+
+    fputs(ring[slot].text, stdout);
+    if (runlog) {
+      fputs(ring[slot].text, runlog);
+    }
+
+    set_sequence(slot, dequeue_pos + LOG_RING_SIZE);
+    dequeue_pos++;
+    count++;
+  }
+
+  unsigned long lost = atomic_exchange(&dropped, 0);
+  if (lost) {
+    fprintf(stdout, "WARNING: %lu log messages dropped\n", lost);
+    if (runlog) {
+      fprintf(runlog, "WARNING: %lu log messages dropped\n", lost);
+    }
+    count++;
+  }
+
+  if (count) {
+    fflush(stdout);
+    if (runlog) {
+      fflush(runlog);
+    }
+  }
+  return count;
+}
+
+static void *writer_main(void *arg) {
+  const struct timespec poll = {0, LOG_POLL_INTERVAL};
+
+  while (!atomic_load(&stopping)) {
+    if (!ring_drain()) {
+      nanosleep(&poll, NULL);
+    }
+  }
+  ring_drain();
+
+  return NULL;
+}
+
+/**
+ * Open the logfile and start the writer thread
+ *
+ * @param {char *} logfile Path of the logfile, will be overwritten
+ * @param {int} level Messages above this level are discarded
+ * @returns {int} 0 on success, -1 on failure
+ */
+int log_init(char *logfile, int level) {
+  atomic_store(&log_level, level);
+
+  runlog = fopen(logfile, "w");
+  if (! runlog) {
+    return -1;
+  }
+  runlog_fd = fileno(runlog);
+
+  // SIGINT should be handled by the main thread
+  sigset_t mask, old;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &mask, &old);
+  int error = pthread_create(&writer, NULL, writer_main, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (error) {
+    fclose(runlog);
+    runlog = NULL;
+    return -1;
+  }
+
+  running = 1;
+  atexit(log_close);
+  return 0;
+}
+
+/**
+ * Write out pending messages, stop the writer thread and close the logfile
+ */
+void log_close() {
+  if (! running) {
+    return;
+  }
+  running = 0;
+
+  atomic_store(&stopping, 1);
+  pthread_join(writer, NULL);
+
+  fclose(runlog);
+  runlog = NULL;
+  runlog_fd = -1;
+}
+
+/**
+ * Format a message and queue it for writing; does not block on I/O
+ */
+void log_printf(int level, const char *format, ...) {
+  if (level > atomic_load_explicit(&log_level, memory_order_relaxed)) {
+    return;
+  }
+
+  size_t pos = ring_claim();
+  if (pos == SIZE_MAX) {
+    atomic_fetch_add(&dropped, 1);
+    return;
+  }
+
+  va_list args;
+  va_start(args, format);
+  vsnprintf(ring[pos & (LOG_RING_SIZE - 1)].text, LOG_MESSAGE_SIZE, format, args);
+  va_end(args);
+
+  set_sequence(pos & (LOG_RING_SIZE - 1), pos + 1);
+}
+
+/**
+ * Returns 1 if the message from this call site should be logged
+ *
+ * Suppressed messages are counted, and reported by the writer thread.
+ */
+int log_ratelimit(log_ratelimit_t *limit, const char *file, int line) {
+  if (atomic_exchange(&limit->registered, 1) == 0) {
+    limit->file = file;
+    limit->line = line;
+    log_ratelimit_t *head = atomic_load(&ratelimits);
+    do {
+      limit->next = head;
+    } while (!atomic_compare_exchange_weak(&ratelimits, &head, limit));
+  }
+
+  long now = (long) time(NULL);
+  long window = atomic_load(&limit->window);
+
+  if (window != now && atomic_compare_exchange_strong(&limit->window, &window, now)) {
+    atomic_store(&limit->count, 0);
+  }
+
+  if (atomic_fetch_add(&limit->count, 1) < limit->burst) {
+    return 1;
+  }
+  atomic_fetch_add(&limit->suppressed, 1);
+  return 0;
+}
+
+/**
+ * Write a message directly, bypassing the ring; async-signal-safe
+ */
+void log_signal_safe(const char *message) {
+  size_t len = strlen(message);
+  ssize_t size = write(STDOUT_FILENO, message, len);
+  if (runlog_fd >= 0) {
+    size = write(runlog_fd, message, len);
+  }
+}
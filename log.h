@@ -0,0 +1,53 @@
+#ifndef __HAVE_LOG_H__
+#define __HAVE_LOG_H__
+
+#include <stdatomic.h>
+
+/**
+ * Asynchronous logging
+ *
+ * Messages are formatted by the caller into a fixed size lock-free ring,
+ * a background thread writes them to stdout and the logfile and flushes in batches.
+ * Formatting in the caller (vsnprintf, no I/O) is deliberate: arguments such as strings
+ * on the caller's stack would otherwise have to be copied into the ring anyway.
+ * When the ring is full (ie. the log disk stalls) messages are dropped and counted,
+ * so memory use is bounded and the caller never blocks on I/O.
+ */
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3
+
+// Per call site rate limit state, see LOG_RATELIMITED
+typedef struct log_ratelimit {
+  const int burst;        // maximum number of messages per second
+  atomic_long window;     // current one second window
+  atomic_int count;       // messages logged in the current window
+  atomic_int suppressed;  // messages suppressed, not yet reported
+
+  // registration with the writer thread, which reports suppressed messages
+  atomic_int registered;
+  const char *file;
+  int line;
+  struct log_ratelimit *next;
+} log_ratelimit_t;
+
+extern int log_init(char *logfile, int level);
+extern void log_close();
+extern void log_printf(int level, const char *format, ...) __attribute__ ((format (printf, 2, 3)));
+extern int log_ratelimit(log_ratelimit_t *limit, const char *file, int line);
+extern void log_signal_safe(const char *message);
+
+#define LOG_ERROR(...) log_printf(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) log_printf(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG(...) log_printf(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) log_printf(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+// Log at most 'burst' messages per second from this call site
+#define LOG_RATELIMITED(level, max_per_second, ...) { \
+  static log_ratelimit_t limit = {.burst = (max_per_second)}; \
+  if (log_ratelimit(&limit, __FILE__, __LINE__)) log_printf(level, __VA_ARGS__); \
+}
+
+#endif
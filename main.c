@@ -11,6 +11,7 @@
  * Author: Jisk Attema, Netherlands eScience Center
  * Licencse: Apache v2.0
  */
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,17 +19,29 @@
 #include <getopt.h>
 #include <errno.h>
 #include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "dada_hdu.h"
 #include "ascii_header.h"
 #include "filterbank.h"
+#include "log.h"
+#include "transpose.h"
+#include "checksum.h"
+#include "stats.h"
+#include "pool.h"
 #include "config.h"
 
 #define MAXTABS 12
 int output[MAXTABS];
+int nfiles = 0;
 
-FILE *runlog = NULL;
-#define LOG(...) {fprintf(stdout, __VA_ARGS__); fprintf(runlog, __VA_ARGS__); fflush(stdout); fflush(runlog);}
+// Set from the SIGINT handler, checked by the main loop
+volatile sig_atomic_t interrupted = 0;
 
 // Hardcoded parameters
 const unsigned int nchannels = 1536; // Must be divisible by 6 for the current transpose/inverse implementation
@@ -46,6 +59,45 @@ char source_name[256];
 double az_start;
 double za_start;
 double mjd_start;
+int page_ntimes = 0; // optional, time samples per page for low latency operation with small pages
+
+// Output layout, set from the commandline
+int interleave_beams = 0;    // write all TABs to a single [time, beam, channel] file
+int ascending_frequency = 0; // keep the native channel order (positive foff) instead of reversing it
+
+// Checksum manifest per file, enabled from the commandline
+int checksums = 0;
+FILE *manifest[MAXTABS];
+off_t data_offset[MAXTABS];    // length of the filterbank header
+uint64_t data_length[MAXTABS]; // number of bytes written after the header
+uint32_t data_crc[MAXTABS];    // CRC32C of the bytes written after the header
+crc32c_stripes_t crc_stripes;  // with interleaved beams, checksum every beam of a block right after its transpose
+
+// Statistics sidecar, written every stats_interval pages when enabled from the commandline
+int stats_interval = 0;
+stats_t *stats = NULL;
+FILE *stats_file = NULL;
+
+// Worker threads, set from the commandline
+pool_t *pool = NULL;
+int max_threads = 0;         // defaults to the number of cores
+int *cores = NULL;           // cores to pin the workers to, not pinned by default
+int ncores = 0;
+double target_margin = 0.25; // fraction of the page time to keep free
+
+// Low latency: transpose and write each page in chunks of this many time samples, set from the commandline
+int chunk_times = 0;
+
+// Offline conversion of a directory of raw page dumps, set from the commandline
+char *raw_directory = NULL;
+
+// Size in bytes of the output buffer per worker for offline conversion
+#define OFFLINE_CHUNK_SIZE (8 * 1024 * 1024)
+
+// Adapting the number of threads: smoothing factor for the measured times,
+// and number of pages in a row that must do with fewer threads before shrinking
+#define ADAPT_SMOOTHING 0.25
+#define ADAPT_SHRINK_PAGES 8
 
 // Derived parameters (with default to lowest data rate)
 double tsamp = 1.024 / 12500;
@@ -53,100 +105,127 @@ int ntimes = 12500;
 int ntabs = 1;
 
 /**
- * Open a connection to the ringbuffer
+ * Read the observation parameters from a psrdada header
  *
- * @param {char *} key String containing the shared memory key as hexadecimal number
- * @returns {hdu *} A connected HDU
+ * @param {char *} header The header block contents
+ * @returns {int} 0 when all required parameters are set, 1 otherwise
  */
-dada_hdu_t *init_ringbuffer(char *key) {
-  uint64_t nbufs;
+int parse_header(char *header) {
   int header_incomplete = 0;
 
-  multilog_t* multilog = NULL; // TODO: See if this is used in anyway by dada
-
-  // create hdu
-  dada_hdu_t *hdu = dada_hdu_create (multilog);
-
-  // init key
-  key_t shmkey;
-  sscanf(key, "%x", &shmkey);
-  dada_hdu_set_key(hdu, shmkey);
-  LOG("dadafilterbank SHMKEY: %s\n", key);
-
-  // connect
-  if (dada_hdu_connect (hdu) < 0) {
-    LOG("ERROR in dada_hdu_connect\n");
-    exit(EXIT_FAILURE);
-  }
-
-  // Make data buffers readable
-  if (dada_hdu_lock_read(hdu) < 0) {
-    LOG("ERROR in dada_hdu_open_view\n");
-    exit(EXIT_FAILURE);
-  }
-
-  // get write address
-  char *header;
-  uint64_t bufsz;
-  header = ipcbuf_get_next_read (hdu->header_block, &bufsz);
-  if (! header || ! bufsz) {
-    LOG("ERROR. Get next header block error\n");
-    exit(EXIT_FAILURE);
-  }
-
-  // parse header
   if(ascii_header_get(header, "MIN_FREQUENCY", "%lf", &min_frequency) == -1) {
-    LOG("ERROR. MIN_FREQUENCY not set in dada buffer\n");
+    LOG_ERROR("ERROR. MIN_FREQUENCY not set in dada buffer\n");
     header_incomplete = 1;
   }
   if(ascii_header_get(header, "BW", "%lf", &bandwidth) == -1) {
-    LOG("ERROR. BW not set in dada buffer\n");
+    LOG_ERROR("ERROR. BW not set in dada buffer\n");
     header_incomplete = 1;
   }
   if(ascii_header_get(header, "RA", "%lf", &ra) == -1) {
-    LOG("ERROR. RA not set in dada buffer\n");
+    LOG_ERROR("ERROR. RA not set in dada buffer\n");
     header_incomplete = 1;
   }
   if(ascii_header_get(header, "DEC", "%lf", &dec) == -1) {
-    LOG("ERROR. DEC not set in dada buffer\n");
+    LOG_ERROR("ERROR. DEC not set in dada buffer\n");
     header_incomplete = 1;
   }
   if(ascii_header_get(header, "SOURCE", "%s", source_name) == -1) {
-    LOG("ERROR. SOURCE not set in dada buffer\n");
+    LOG_ERROR("ERROR. SOURCE not set in dada buffer\n");
     header_incomplete = 1;
   }
   if(ascii_header_get(header, "AZ_START", "%lf", &az_start) == -1) {
-    LOG("ERROR. AZ_START not set in dada buffer\n");
+    LOG_ERROR("ERROR. AZ_START not set in dada buffer\n");
     header_incomplete = 1;
   }
   if(ascii_header_get(header, "ZA_START", "%lf", &za_start) == -1) {
-    LOG("ERROR. ZA_START not set in dada buffer\n");
+    LOG_ERROR("ERROR. ZA_START not set in dada buffer\n");
     header_incomplete = 1;
   }
   if(ascii_header_get(header, "MJD_START", "%lf", &mjd_start) == -1) {
-    LOG("ERROR. MJD_START not set in dada buffer\n");
+    LOG_ERROR("ERROR. MJD_START not set in dada buffer\n");
     header_incomplete = 1;
   }
   if(ascii_header_get(header, "SCIENCE_CASE", "%i", &science_case) == -1) {
-    LOG("ERROR. SCIENCE_CASE not set in dada buffer\n");
+    LOG_ERROR("ERROR. SCIENCE_CASE not set in dada buffer\n");
     header_incomplete = 1;
   }
   if(ascii_header_get(header, "SCIENCE_MODE", "%i", &science_mode) == -1) {
-    LOG("ERROR. SCIENCE_MODE not set in dada buffer\n");
+    LOG_ERROR("ERROR. SCIENCE_MODE not set in dada buffer\n");
     header_incomplete = 1;
   }
   if(ascii_header_get(header, "PADDED_SIZE", "%i", &padded_size) == -1) {
-    LOG("ERROR. PADDED_SIZE not set in dada buffer\n");
+    LOG_ERROR("ERROR. PADDED_SIZE not set in dada buffer\n");
     header_incomplete = 1;
   }
 
+  // optional; leave the default for the science case when not set
+  if(ascii_header_get(header, "NTIMES", "%i", &page_ntimes) == -1) {
+    page_ntimes = 0;
+  }
+
+  // log line by line, as log messages have a maximum length
+  LOG("psrdada HEADER:\n");
+  char *line = header;
+  while (*line) {
+    int len = strcspn(line, "\n");
+    LOG("%.*s\n", len, line);
+    line += len;
+    if (*line) line++;
+  }
+  LOG("\n");
+
+  return header_incomplete;
+}
+
+/**
+ * Open a connection to the ringbuffer
+ *
+ * @param {char *} key String containing the shared memory key as hexadecimal number
+ * @returns {hdu *} A connected HDU
+ */
+dada_hdu_t *init_ringbuffer(char *key) {
+  uint64_t nbufs;
+
+  multilog_t* multilog = NULL; // TODO: See if this is used in anyway by dada
+
+  // create hdu
+  dada_hdu_t *hdu = dada_hdu_create (multilog);
+
+  // init key
+  key_t shmkey;
+  sscanf(key, "%x", &shmkey);
+  dada_hdu_set_key(hdu, shmkey);
+  LOG("dadafilterbank SHMKEY: %s\n", key);
+
+  // connect
+  if (dada_hdu_connect (hdu) < 0) {
+    LOG_ERROR("ERROR in dada_hdu_connect\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Make data buffers readable
+  if (dada_hdu_lock_read(hdu) < 0) {
+    LOG_ERROR("ERROR in dada_hdu_open_view\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // get write address
+  char *header;
+  uint64_t bufsz;
+  header = ipcbuf_get_next_read (hdu->header_block, &bufsz);
+  if (! header || ! bufsz) {
+    LOG_ERROR("ERROR. Get next header block error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int header_incomplete = parse_header(header);
+
   // tell the ringbuffer the header has been read
   if (ipcbuf_mark_cleared(hdu->header_block) < 0) {
-    LOG("ERROR. Cannot mark the header as cleared\n");
+    LOG_ERROR("ERROR. Cannot mark the header as cleared\n");
     exit(EXIT_FAILURE);
   }
 
-  LOG("psrdada HEADER:\n%s\n", header);
   if (header_incomplete) {
     exit(EXIT_FAILURE);
   }
@@ -158,18 +237,61 @@ dada_hdu_t *init_ringbuffer(char *key) {
  * Print commandline options
  */
 void printOptions() {
-  printf("usage: dadafilterbank -k <hexadecimal key> -l <logfile> -n <filename prefix for dumps>\n");
+  printf("usage: dadafilterbank -k <hexadecimal key> -l <logfile> -n <filename prefix for dumps> [-i] [-a] [-c] [-s <pages>] [-t <threads>] [-p <core list>] [-m <margin>] [-L <samples>] [-v]\n");
+  printf("       dadafilterbank -r <directory with raw pages> -l <logfile> -n <filename prefix for dumps> [-i] [-a] [-c] [-t <threads>] [-p <core list>] [-v]\n");
   printf("e.g. dadafits -k dada -l log.txt -n myobs\n");
   return;
 }
 
+/**
+ * Parse a list of cores like '0,2,4-7' into cores and ncores
+ *
+ * Every core must be online and available to this process
+ */
+void parseCores(char *list) {
+  cpu_set_t available;
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &available)) {
+    fprintf(stderr, "Error: Cannot get the cores available to this process\n");
+    exit(EXIT_FAILURE);
+  }
+
+  char *copy = strdup(list);
+  char *saveptr = NULL;
+  char *range;
+
+  for (range = strtok_r(copy, ",", &saveptr); range; range = strtok_r(NULL, ",", &saveptr)) {
+    int first, last;
+    int n = sscanf(range, "%i-%i", &first, &last);
+    if (n == 1) {
+      last = first;
+    }
+    if (n < 1 || first < 0 || last < first || last >= CPU_SETSIZE) {
+      fprintf(stderr, "Error: Illegal core list '%s'\n", list);
+      exit(EXIT_FAILURE);
+    }
+
+    int core;
+    for (core = first; core <= last; core++) {
+      if (! CPU_ISSET(core, &available)) {
+        fprintf(stderr, "Error: Core %i in core list '%s' is not online or not available to this process (%i cores available)\n",
+            core, list, CPU_COUNT(&available));
+        exit(EXIT_FAILURE);
+      }
+      cores = realloc(cores, (ncores + 1) * sizeof(int));
+      cores[ncores++] = core;
+    }
+  }
+
+  free(copy);
+}
+
 /**
  * Parse commandline
  */
-void parseOptions(int argc, char *argv[], char **key, char **prefix, char **logfile) {
+void parseOptions(int argc, char *argv[], char **key, char **prefix, char **logfile, int *loglevel) {
   int c;
   int setk=0, setl=0, setn=0;
-  while((c=getopt(argc,argv,"b:c:m:k:l:n:"))!=-1) {
+  while((c=getopt(argc,argv,"b:k:l:n:iacs:t:p:m:L:r:v"))!=-1) {
     switch(c) {
       // -k <hexadecimal_key>
       case('k'):
@@ -189,6 +311,72 @@ void parseOptions(int argc, char *argv[], char **key, char **prefix, char **logf
         *prefix = strdup(optarg);
         break;
 
+      // -i interleave TABs in a single file
+      case('i'):
+        interleave_beams = 1;
+        break;
+
+      // -a ascending frequency order
+      case('a'):
+        ascending_frequency = 1;
+        break;
+
+      // -c write checksum manifests
+      case('c'):
+        checksums = 1;
+        break;
+
+      // -s <pages per statistics record>
+      case('s'):
+        stats_interval = atoi(optarg);
+        if (stats_interval <= 0) {
+          fprintf(stderr, "Error: Illegal statistics interval '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      // -t <maximum number of threads>
+      case('t'):
+        max_threads = atoi(optarg);
+        if (max_threads <= 0) {
+          fprintf(stderr, "Error: Illegal number of threads '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      // -p <core list>
+      case('p'):
+        parseCores(optarg);
+        break;
+
+      // -m <target margin>
+      case('m'):
+        target_margin = atof(optarg);
+        if (target_margin < 0 || target_margin >= 1) {
+          fprintf(stderr, "Error: Illegal target margin '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      // -L <samples per chunk>
+      case('L'):
+        chunk_times = atoi(optarg);
+        if (chunk_times <= 0) {
+          fprintf(stderr, "Error: Illegal chunk size '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      // -r <directory with raw pages>
+      case('r'):
+        raw_directory = strdup(optarg);
+        break;
+
+      // -v verbose logging
+      case('v'):
+        *loglevel = LOG_LEVEL_DEBUG;
+        break;
+
       // -h
       case('h'):
         printOptions();
@@ -203,6 +391,13 @@ void parseOptions(int argc, char *argv[], char **key, char **prefix, char **logf
   }
 
   // All arguments are required
+  if (raw_directory) {
+    setk = 1;
+    if (stats_interval) {
+      fprintf(stderr, "Error: Statistics are not supported for raw pages\n");
+      exit(EXIT_FAILURE);
+    }
+  }
   if (!setk || !setl || !setn) {
     if (!setk) fprintf(stderr, "Error: DADA key not set\n");
     if (!setl) fprintf(stderr, "Error: Log file not set\n");
@@ -212,18 +407,29 @@ void parseOptions(int argc, char *argv[], char **key, char **prefix, char **logf
 }
 
 void open_files(char *prefix, int ntabs) {
-  int tab;
-  for (tab=0; tab<ntabs; tab++) {
+  // first channel and channel width, in the order written to file
+  double fch1 = min_frequency + bandwidth - (bandwidth / nchannels);
+  double foff = -1 * bandwidth / nchannels;
+  if (ascending_frequency) {
+    fch1 = min_frequency;
+    foff = bandwidth / nchannels;
+  }
+
+  // interleaved TABs go to a single file, with nbeams set and ibeam 0
+  nfiles = interleave_beams ? 1 : ntabs;
+
+  int file;
+  for (file=0; file<nfiles; file++) {
     char fname[256];
-    if (ntabs == 1) {
+    if (nfiles == 1) {
       snprintf(fname, 256, "%s.fil", prefix);
     }
     else {
-      snprintf(fname, 256, "%s_%02i.fil", prefix, tab);
+      snprintf(fname, 256, "%s_%02i.fil", prefix, file);
     }
 
     // open filterbank file
-    output[tab] = filterbank_create(
+    output[file] = filterbank_create(
       fname,       // filename
       10,          // int telescope_id,
       15,          // int machine_id,
@@ -235,37 +441,683 @@ void open_files(char *prefix, int ntabs) {
       mjd_start,   // double tstart
       tsamp,       // double tsamp,
       nbit,        // int nbits,
-      min_frequency + bandwidth - (bandwidth / nchannels),  // double fch1,
-      -1 * bandwidth / nchannels, // double foff,
+      fch1,        // double fch1,
+      foff,        // double foff,
       nchannels, // int nchans,
       ntabs,     // int nbeams,
-      tab,   // int ibeam
+      file,      // int ibeam
       1          // int nifs
     );
+    data_offset[file] = lseek(output[file], 0, SEEK_CUR);
+
+    if (checksums) {
+      char mname[266];
+      snprintf(mname, 266, "%s.manifest", fname);
+      manifest[file] = fopen(mname, "w");
+      if (! manifest[file]) {
+        LOG_ERROR("ERROR opening checksum manifest: %s\n", mname);
+        exit(EXIT_FAILURE);
+      }
+      fprintf(manifest[file], "# file %s\n", fname);
+      fprintf(manifest[file], "# algorithm crc32c\n");
+      fprintf(manifest[file], "# segment <page> <offset> <length> <crc>\n");
+      fprintf(manifest[file], "# file <offset> <length> <crc>\n");
+    }
   }
 }
 
+/**
+ * Open the statistics sidecar and allocate an accumulator per thread
+ */
+void open_stats(char *prefix) {
+  char fname[256];
+  snprintf(fname, 256, "%s.stats", prefix);
+  stats_file = fopen(fname, "w");
+  if (! stats_file) {
+    LOG_ERROR("ERROR opening statistics file: %s\n", fname);
+    exit(EXIT_FAILURE);
+  }
+
+  stats = stats_create(pool->nworkers, ntabs, nchannels, ntimes, stats_interval);
+
+  // a page length without a reasonable divisor (ie. a prime) would give a point per sample
+  if (stats->power_samples < ntimes && stats->power_samples < STATS_POWER_SAMPLES / 10) {
+    LOG_ERROR("Error: Cannot write statistics for pages of %i samples, the total power points would be %i samples\n",
+        ntimes, stats->power_samples);
+    exit(EXIT_FAILURE);
+  }
+  LOG("Total power points of %i samples\n", stats->power_samples);
+}
+
+/**
+ * Write a statistics record for the pages processed since the previous record
+ */
+void write_stats(int page_count) {
+  int npages = page_count % stats_interval ? page_count % stats_interval : stats_interval;
+  int first_page = page_count - npages;
+
+  stats_write(stats, stats_file, first_page, npages,
+      mjd_start + first_page * ntimes * tsamp / 86400.0, tsamp);
+}
+
+void close_stats(int page_count) {
+  if (page_count % stats_interval) {
+    write_stats(page_count);
+  }
+  fclose(stats_file);
+  stats_destroy(stats);
+}
+
+/**
+ * Write the checksum over all data and close the manifests
+ */
+void close_manifests() {
+  int file;
+
+  for (file=0; file<nfiles; file++) {
+    if (manifest[file]) {
+      fprintf(manifest[file], "file %lli %llu %08x\n",
+          (long long) data_offset[file], (unsigned long long) data_length[file], data_crc[file]);
+      fclose(manifest[file]);
+      manifest[file] = NULL;
+    }
+  }
+  crc32c_stripes_free(&crc_stripes);
+}
+
 void close_files() {
-  int tab;
+  int file;
+
+  for (file=0; file<nfiles; file++) {
+    filterbank_close(output[file]);
+  }
+}
+
+void sync_files() {
+  int file;
 
-  for (tab=0; tab<ntabs; tab++) {
-    filterbank_close(output[tab]);
+  for (file=0; file<nfiles; file++) {
+    if (output[file]) {
+      fsync(output[file]);
+    }
   }
 }
 
 /**
- * Catch SIGINT then sync and close files before exiting
+ * Start the worker pool, using all allowed threads initially
  */
-void sigint_handler (int sig) {
-  LOG("SIGINT received, aborting\n");
-  int i;
-  for (i=0; i<ntabs; i++) {
-    if (output[i]) {
-      fsync(output[i]);
-      filterbank_close(output[i]);
+void start_pool() {
+  if (! max_threads) {
+    max_threads = ncores ? ncores : sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (ncores && ncores < max_threads) {
+    LOG_ERROR("Error: %i threads, but only %i cores in the core list\n", max_threads, ncores);
+    exit(EXIT_FAILURE);
+  }
+
+  int failed_core;
+  pool = pool_create(max_threads, cores, &failed_core);
+  if (! pool) {
+    LOG_ERROR("Error: Cannot pin a worker thread to core %i\n", failed_core);
+    exit(EXIT_FAILURE);
+  }
+  LOG("Threads: %i, target margin %.2f\n", max_threads, target_margin);
+  if (cores) {
+    int worker;
+    for (worker = 0; worker < max_threads; worker++) {
+      LOG_DEBUG("Worker %i pinned to core %i\n", worker, cores[worker]);
     }
   }
-  exit(EXIT_FAILURE);
+}
+
+/**
+ * Choose the number of threads for the next page from the measured processing time of a page
+ *
+ * The page time is modelled as a serial part (writing the files) and a parallel part (transpose etc.)
+ * that scales with the number of threads. Use the fewest threads that keep a fraction target_margin of the page time free.
+ * Grow as soon as needed, but only shrink when the last ADAPT_SHRINK_PAGES pages could do with fewer threads.
+ *
+ * @param {double} parallel_time Time spent in the worker pool (s)
+ * @param {double} serial_time Time spent in the main thread only (s)
+ */
+void adapt_threads(double parallel_time, double serial_time) {
+  static double work = -1;   // smoothed thread-seconds in the worker pool
+  static double serial = -1; // smoothed seconds in the main thread
+  static int shrink_pages = 0;
+
+  const int nactive = pool->nactive;
+  const double page_time = ntimes * tsamp;
+
+  if (parallel_time + serial_time > page_time) {
+    LOG_RATELIMITED(LOG_LEVEL_WARN, 1, "WARNING: page took %.3f s, longer than realtime (%.3f s) with %i threads\n",
+        parallel_time + serial_time, page_time, nactive);
+  }
+  LOG_DEBUG("Page time %.3f s (parallel %.3f s, serial %.3f s) with %i threads\n",
+      parallel_time + serial_time, parallel_time, serial_time, nactive);
+
+  if (work < 0) {
+    work = parallel_time * nactive;
+    serial = serial_time;
+  } else {
+    work += ADAPT_SMOOTHING * (parallel_time * nactive - work);
+    serial += ADAPT_SMOOTHING * (serial_time - serial);
+  }
+
+  // time available for the parallel part
+  const double available = page_time * (1.0 - target_margin) - serial;
+
+  int needed = 1;
+  while (needed < pool->nworkers && (available <= 0 || work / needed > available)) {
+    needed++;
+  }
+
+  if (needed > nactive) {
+    shrink_pages = 0;
+  } else if (needed < nactive && ++shrink_pages >= ADAPT_SHRINK_PAGES) {
+    shrink_pages = 0;
+  } else {
+    if (needed == nactive) {
+      shrink_pages = 0;
+    }
+    return;
+  }
+
+  pool_set_active(pool, needed);
+  LOG("Threads: %i (page time %.3f s of %.3f s)\n", needed, parallel_time + serial_time, page_time);
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// A range of time samples of a page being processed by the worker pool, with a task per block of time samples per file
+typedef struct {
+  const char *page;
+  char *buffer;
+  int page_index;
+  int time_start;      // first time sample of the range
+  int time_end;        // one past the last time sample of the range
+  int row_size;        // bytes per time sample in a file
+  int block_times;     // time samples per block
+  int nblocks;         // blocks per file
+  uint32_t *block_crc; // [nfiles, nblocks]
+} page_job_t;
+
+static void transpose_task(void *arg, int task, int worker) {
+  const page_job_t *job = (page_job_t *) arg;
+  const int file = task / job->nblocks;
+  const int block = task % job->nblocks;
+  const int row_size = job->row_size;
+
+  const int time_start = job->time_start + block * job->block_times;
+  const int time_end = time_start + job->block_times < job->time_end ? time_start + job->block_times : job->time_end;
+  char *block_out = &job->buffer[file * ntimes * row_size + time_start * row_size];
+
+  if (interleave_beams) {
+    // the block holds all beams, so process every beam while its part of the block is in cache
+    uint32_t crc = 0;
+    int tab;
+    for (tab = 0; tab < ntabs; tab++) {
+      transpose_block(job->page, &block_out[tab * nchannels], tab, nchannels, time_start, time_end, padded_size, row_size, !ascending_frequency);
+      if (stats) {
+        stats_add(stats, worker, &block_out[tab * nchannels], tab, time_start, time_end, row_size, job->page_index % stats_interval);
+      }
+      if (checksums) {
+        crc ^= crc32c_stripe(&crc_stripes, tab, &block_out[tab * nchannels], time_end - time_start);
+      }
+    }
+    job->block_crc[task] = crc;
+  } else {
+    transpose_block(job->page, block_out, file, nchannels, time_start, time_end, padded_size, row_size, !ascending_frequency);
+    if (stats) {
+      stats_add(stats, worker, block_out, file, time_start, time_end, row_size, job->page_index % stats_interval);
+    }
+    if (checksums) {
+      job->block_crc[task] = crc32c_update(0, block_out, (time_end - time_start) * row_size);
+    }
+  }
+}
+
+/**
+ * Write all data to a file, continuing after short writes
+ *
+ * @returns {int} 0 on success, -1 on failure (see errno)
+ */
+static int write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t size = write(fd, data, length);
+    if (size < 0 && errno == EINTR) {
+      continue;
+    }
+    if (size <= 0) {
+      return -1;
+    }
+    data += size;
+    length -= size;
+  }
+  return 0;
+}
+
+/**
+ * Write all data to a file at the given offset, continuing after short writes
+ *
+ * @returns {int} 0 on success, -1 on failure (see errno)
+ */
+static int pwrite_all(int fd, const char *data, size_t length, off_t offset) {
+  while (length > 0) {
+    ssize_t size = pwrite(fd, data, length, offset);
+    if (size < 0 && errno == EINTR) {
+      continue;
+    }
+    if (size <= 0) {
+      return -1;
+    }
+    data += size;
+    length -= size;
+    offset += size;
+  }
+  return 0;
+}
+
+/**
+ * Transpose a ringbuffer page, write it to the filterbank files, and update the checksums
+ *
+ * Every file is processed in blocks of time samples that fit in cache, distributed over the worker pool;
+ * the block length follows from nchannels, with interleaved beams a block holds all beams of its time samples.
+ * The checksum and statistics are calculated directly after the transpose of a beam, from the output in cache;
+ * with interleaved beams the block as a whole is too large for that, see crc32c_stripe.
+ *
+ * In low latency mode the page is transposed and written in chunks of chunk_times samples,
+ * so the first samples reach the files before the whole page is processed.
+ *
+ * @param {const char *} page Ringbuffer page [NTABS, nchannels, time(padded_size)]
+ * @param {char *} buffer Output buffer of ntabs * ntimes * nchannels bytes
+ * When a file cannot be written, no segment is added to its manifest and the manifest is closed
+ * without the checksum over all data, so it never covers data that is not in the file.
+ *
+ * @param {int} page_index Index of the page, used as segment number in the manifest
+ * @returns {int} 0 on success, -1 when a file could not be written
+ */
+int process_page(const char *page, char *buffer, int page_index) {
+  static crc32c_zeros_t block_zeros, last_block_zeros, page_zeros;
+  page_job_t job;
+
+  // file [time, NTABS, nchannels] or [time, nchannels]
+  job.page = page;
+  job.buffer = buffer;
+  job.page_index = page_index;
+  job.row_size = interleave_beams ? ntabs * nchannels : nchannels;
+  job.block_times = TRANSPOSE_BLOCK_SIZE / nchannels;
+  if (job.block_times < 1) {
+    job.block_times = 1;
+  }
+
+  const int chunk = chunk_times && chunk_times < ntimes ? chunk_times : ntimes;
+  const int max_blocks = (chunk + job.block_times - 1) / job.block_times;
+  uint32_t block_crc[nfiles * max_blocks];
+  job.block_crc = block_crc;
+
+  const int file_size = ntimes * job.row_size;
+  uint32_t page_crc[nfiles];
+  int failed[nfiles];
+  memset(failed, 0, sizeof(failed));
+  double parallel_time = 0;
+  double serial_time = 0;
+
+  for (job.time_start = 0; job.time_start < ntimes; job.time_start += chunk) {
+    job.time_end = job.time_start + chunk < ntimes ? job.time_start + chunk : ntimes;
+    job.nblocks = (job.time_end - job.time_start + job.block_times - 1) / job.block_times;
+
+    double start = now();
+    pool_run(pool, transpose_task, &job, nfiles * job.nblocks);
+    double transposed = now();
+
+    const int chunk_size = (job.time_end - job.time_start) * job.row_size;
+
+    int file;
+    for (file = 0; file < nfiles; file++) {
+      if (failed[file]) {
+        continue;
+      }
+
+      char *out = &buffer[file * file_size + job.time_start * job.row_size];
+      if (write_all(output[file], out, sizeof(char) * chunk_size)) {
+        LOG_ERROR("ERROR writing page %i to filterbank file %i: %s\n", page_index, file, strerror(errno));
+        failed[file] = 1;
+        continue;
+      }
+
+      if (checksums) {
+        uint32_t *crcs = &block_crc[file * job.nblocks];
+        uint32_t crc = job.time_start ? page_crc[file] : 0;
+        int block;
+        for (block = 0; block < job.nblocks - 1; block++) {
+          crc = crc32c_combine_zeros(&block_zeros, crc, crcs[block], job.block_times * job.row_size);
+        }
+        const int last_length = job.time_end - job.time_start - block * job.block_times;
+        crc = crc32c_combine_zeros(&last_block_zeros, crc, crcs[block], last_length * job.row_size);
+        page_crc[file] = crc;
+      }
+    }
+
+    parallel_time += transposed - start;
+    serial_time += now() - transposed;
+  }
+
+  int error = 0;
+  int file;
+  for (file = 0; file < nfiles; file++) {
+    if (failed[file]) {
+      if (manifest[file]) {
+        fclose(manifest[file]);
+        manifest[file] = NULL;
+      }
+      error = -1;
+      continue;
+    }
+
+    if (checksums && manifest[file]) {
+      fprintf(manifest[file], "segment %i %llu %i %08x\n",
+          page_index, (unsigned long long) (data_offset[file] + data_length[file]), file_size, page_crc[file]);
+
+      data_crc[file] = crc32c_combine_zeros(&page_zeros, data_crc[file], page_crc[file], file_size);
+    }
+    data_length[file] += file_size;
+  }
+
+  adapt_threads(parallel_time, serial_time);
+  return error;
+}
+
+/**
+ * Read the psrdada header for raw pages from <directory>/header
+ */
+void read_raw_header(char *directory) {
+  char fname[1024];
+  snprintf(fname, 1024, "%s/header", directory);
+
+  FILE *file = fopen(fname, "r");
+  if (! file) {
+    LOG_ERROR("ERROR opening header file: %s\n", fname);
+    exit(EXIT_FAILURE);
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  char *header = malloc(size + 1);
+  size = fread(header, 1, size, file);
+  header[size] = '\0';
+  fclose(file);
+
+  LOG("Raw pages from: %s\n", directory);
+  if (parse_header(header)) {
+    exit(EXIT_FAILURE);
+  }
+  free(header);
+}
+
+/**
+ * Page number of a raw page, from the digits directly before the .raw suffix, or -1
+ */
+static long raw_page_number(const char *name) {
+  const char *suffix = strrchr(name, '.');
+  if (! suffix || strcmp(suffix, ".raw") != 0) {
+    return -1;
+  }
+
+  const char *digits = suffix;
+  while (digits > name && digits[-1] >= '0' && digits[-1] <= '9') {
+    digits--;
+  }
+  return digits == suffix ? -1 : strtol(digits, NULL, 10);
+}
+
+static int is_raw_page(const struct dirent *entry) {
+  const char *suffix = strrchr(entry->d_name, '.');
+  return suffix && strcmp(suffix, ".raw") == 0;
+}
+
+static int compare_raw_pages(const struct dirent **a, const struct dirent **b) {
+  const long na = raw_page_number((*a)->d_name);
+  const long nb = raw_page_number((*b)->d_name);
+  return na < nb ? -1 : na > nb;
+}
+
+// Raw pages being converted by the worker pool, with a task per page
+typedef struct {
+  char *directory;
+  struct dirent **pages;
+  int *index;          // [npages] position of the page in the files
+  int row_size;        // bytes per time sample in a file
+  int block_times;     // time samples per transpose block
+  int chunk;           // time samples per write
+  char **buffers;      // [nworkers] output buffer of chunk * row_size bytes
+  uint32_t *page_crc;  // [npages, nfiles]
+  atomic_int *done;    // [npages]
+  atomic_int failed;
+} raw_job_t;
+
+/**
+ * Convert a single raw page, and write it to the files at the position of the page
+ *
+ * The page is only marked as done (and gets its manifest segments) when it is written completely.
+ */
+static void convert_task(void *arg, int task, int worker) {
+  raw_job_t *job = (raw_job_t *) arg;
+  if (interrupted || atomic_load(&job->failed)) {
+    return;
+  }
+
+  char fname[1024];
+  snprintf(fname, 1024, "%s/%s", job->directory, job->pages[task]->d_name);
+
+  const size_t page_size = (size_t) ntabs * nchannels * padded_size;
+  int fd = open(fname, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0 || st.st_size != page_size) {
+    LOG_ERROR("ERROR. Cannot read raw page %s of %zu bytes\n", fname, page_size);
+    atomic_store(&job->failed, 1);
+    if (fd >= 0) close(fd);
+    return;
+  }
+  const char *page = mmap(NULL, page_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    LOG_ERROR("ERROR. Cannot map raw page %s\n", fname);
+    atomic_store(&job->failed, 1);
+    return;
+  }
+
+  const int row_size = job->row_size;
+  const int file_size = ntimes * row_size;
+  const int block_times = job->block_times;
+  const int chunk = job->chunk;
+
+  char *out = job->buffers[worker];
+  crc32c_zeros_t block_zeros = {0};
+
+  int file;
+  for (file = 0; file < nfiles; file++) {
+    uint32_t crc = 0;
+
+    int chunk_start;
+    for (chunk_start = 0; chunk_start < ntimes; chunk_start += chunk) {
+      const int chunk_end = chunk_start + chunk < ntimes ? chunk_start + chunk : ntimes;
+
+      // the chunk is processed by this worker only, so the checksum can simply be continued
+      int time_start;
+      for (time_start = chunk_start; time_start < chunk_end; time_start += block_times) {
+        const int time_end = time_start + block_times < chunk_end ? time_start + block_times : chunk_end;
+        char *block_out = &out[(time_start - chunk_start) * row_size];
+
+        if (interleave_beams) {
+          uint32_t block_crc = 0;
+          int tab;
+          for (tab = 0; tab < ntabs; tab++) {
+            transpose_block(page, &block_out[tab * nchannels], tab, nchannels, time_start, time_end, padded_size, row_size, !ascending_frequency);
+            if (checksums) {
+              block_crc ^= crc32c_stripe(&crc_stripes, tab, &block_out[tab * nchannels], time_end - time_start);
+            }
+          }
+          if (checksums) {
+            crc = crc32c_combine_zeros(&block_zeros, crc, block_crc, (time_end - time_start) * row_size);
+          }
+        } else {
+          transpose_block(page, block_out, file, nchannels, time_start, time_end, padded_size, row_size, !ascending_frequency);
+          if (checksums) {
+            crc = crc32c_update(crc, block_out, (time_end - time_start) * row_size);
+          }
+        }
+      }
+
+      const size_t length = (size_t) (chunk_end - chunk_start) * row_size;
+      const off_t offset = data_offset[file] + (off_t) job->index[task] * file_size + (off_t) chunk_start * row_size;
+      if (pwrite_all(output[file], out, length, offset)) {
+        LOG_ERROR("ERROR. Cannot write page %s to file %i: %s\n", fname, file, strerror(errno));
+        atomic_store(&job->failed, 1);
+        munmap((void *) page, page_size);
+        return;
+      }
+    }
+    job->page_crc[task * nfiles + file] = crc;
+  }
+
+  munmap((void *) page, page_size);
+  atomic_store(&job->done[task], 1);
+  LOG_DEBUG("Converted raw page %s\n", fname);
+}
+
+/**
+ * Convert all raw pages in a directory
+ *
+ * The position of a page follows from the number in its file name (ie. page_0012.raw),
+ * counted from the lowest number; missing pages are reported, and left as holes in the files.
+ * Pages are distributed over the worker pool and can finish out of order,
+ * every page is written at its own position in the files.
+ *
+ * @param {char *} directory Directory containing the *.raw pages
+ * @returns {int} Number of pages converted, or -1 when not all pages could be converted and written
+ */
+int convert_raw_pages(char *directory) {
+  raw_job_t job;
+  job.directory = directory;
+
+  int npages = scandir(directory, &job.pages, is_raw_page, compare_raw_pages);
+  if (npages < 0) {
+    LOG_ERROR("ERROR reading directory: %s\n", directory);
+    exit(EXIT_FAILURE);
+  }
+
+  job.index = malloc(npages * sizeof(int));
+  int page;
+  for (page = 0; page < npages; page++) {
+    const long number = raw_page_number(job.pages[page]->d_name);
+    if (number < 0) {
+      LOG_ERROR("ERROR. No page number in raw page file name: %s\n", job.pages[page]->d_name);
+      exit(EXIT_FAILURE);
+    }
+    if (page && number == raw_page_number(job.pages[page - 1]->d_name)) {
+      LOG_ERROR("ERROR. Duplicate raw page number: %s and %s\n", job.pages[page - 1]->d_name, job.pages[page]->d_name);
+      exit(EXIT_FAILURE);
+    }
+    job.index[page] = number - raw_page_number(job.pages[0]->d_name);
+  }
+
+  const int npositions = npages ? job.index[npages - 1] + 1 : 0;
+  LOG("Converting %i raw pages\n", npages);
+  if (npositions != npages) {
+    LOG_ERROR("ERROR. Missing %i raw pages between %s and %s, these are left empty\n",
+        npositions - npages, job.pages[0]->d_name, job.pages[npages - 1]->d_name);
+  }
+
+  // file [time, NTABS, nchannels] or [time, nchannels]
+  job.row_size = interleave_beams ? ntabs * nchannels : nchannels;
+  job.block_times = TRANSPOSE_BLOCK_SIZE / nchannels;
+  if (job.block_times < 1) {
+    job.block_times = 1;
+  }
+  job.chunk = (OFFLINE_CHUNK_SIZE / job.row_size / job.block_times) * job.block_times;
+  if (job.chunk < job.block_times) {
+    job.chunk = job.block_times;
+  }
+
+  const size_t buffer_size = (size_t) job.chunk * job.row_size;
+  job.buffers = malloc(pool->nworkers * sizeof(char *));
+  int worker;
+  for (worker = 0; worker < pool->nworkers; worker++) {
+    job.buffers[worker] = malloc(buffer_size);
+  }
+  job.page_crc = malloc(npages * nfiles * sizeof(uint32_t));
+  job.done = calloc(npages, sizeof(atomic_int));
+  atomic_init(&job.failed, 0);
+
+  pool_run(pool, convert_task, &job, npages);
+
+  // manifest in page order; the checksum over all data only when all pages are converted
+  int converted = 0;
+  for (page = 0; page < npages; page++) {
+    converted += atomic_load(&job.done[page]);
+  }
+
+  const int file_size = ntimes * (interleave_beams ? ntabs * nchannels : nchannels);
+  crc32c_zeros_t page_zeros = {0};
+  int file;
+  for (file = 0; file < nfiles; file++) {
+    if (checksums) {
+      for (page = 0; page < npages; page++) {
+        if (atomic_load(&job.done[page])) {
+          fprintf(manifest[file], "segment %i %llu %i %08x\n",
+              job.index[page], (unsigned long long) (data_offset[file] + (off_t) job.index[page] * file_size),
+              file_size, job.page_crc[page * nfiles + file]);
+          data_crc[file] = crc32c_combine_zeros(&page_zeros, data_crc[file], job.page_crc[page * nfiles + file], file_size);
+        }
+      }
+      if (converted != npositions || atomic_load(&job.failed)) {
+        fclose(manifest[file]);
+        manifest[file] = NULL;
+      }
+    }
+    data_length[file] = (uint64_t) npositions * file_size;
+  }
+
+  if (atomic_load(&job.failed) || converted != npages) {
+    LOG_ERROR("ERROR. Converted only %i of %i raw pages\n", converted, npages);
+  }
+
+  for (page = 0; page < npages; page++) {
+    free(job.pages[page]);
+  }
+  free(job.pages);
+  free(job.index);
+  for (worker = 0; worker < pool->nworkers; worker++) {
+    free(job.buffers[worker]);
+  }
+  free(job.buffers);
+  free(job.page_crc);
+  free((void *) job.done);
+
+  return converted == npositions && ! atomic_load(&job.failed) ? npages : -1;
+}
+
+/**
+ * Catch SIGINT and let the main loop sync and close files before exiting.
+ * A second SIGINT syncs and closes the files immediately.
+ *
+ * Only async-signal-safe functions may be called from here.
+ */
+void sigint_handler (int sig) {
+  if (interrupted) {
+    log_signal_safe("SIGINT received again, exiting\n");
+    sync_files();
+    close_files();
+    _exit(EXIT_FAILURE);
+  }
+
+  interrupted = 1;
+  log_signal_safe("SIGINT received, aborting\n");
 }
 
 
@@ -273,25 +1125,28 @@ int main (int argc, char *argv[]) {
   char *key;
   char *logfile;
   char *file_prefix;
+  int loglevel = LOG_LEVEL_INFO;
 
   // parse commandline
-  parseOptions(argc, argv, &key, &file_prefix, &logfile);
+  parseOptions(argc, argv, &key, &file_prefix, &logfile, &loglevel);
 
   // set up logging
   if (logfile) {
-    runlog = fopen(logfile, "w");
-    if (! runlog) {
-      LOG("ERROR opening logfile: %s\n", logfile);
+    if (log_init(logfile, loglevel)) {
+      fprintf(stderr, "ERROR opening logfile: %s\n", logfile);
       exit(EXIT_FAILURE);
     }
     LOG("Logging to logfile: %s\n", logfile);
     free (logfile);
   }
 
-  // connect to ring buffer
-  dada_hdu_t *ringbuffer = init_ringbuffer(key);
-  ipcbuf_t *data_block = (ipcbuf_t *) ringbuffer->data_block;
-  ipcio_t *ipc = ringbuffer->data_block;
+  // connect to ring buffer, or read the header of the raw pages
+  dada_hdu_t *ringbuffer = NULL;
+  if (raw_directory) {
+    read_raw_header(raw_directory);
+  } else {
+    ringbuffer = init_ringbuffer(key);
+  }
 
   if (science_case == 3) {
     // NTIMES (12500) per 1.024 seconds -> 0.00008192 [s]
@@ -304,13 +1159,26 @@ int main (int argc, char *argv[]) {
     tsamp = 1.024 / 12500;
     ntabs = 12;
   } else {
-    LOG("Error: Illegal science case '%i'", science_mode);
+    LOG_ERROR("Error: Illegal science case '%i'", science_mode);
     exit(EXIT_FAILURE);
   }
 
+  // smaller pages for low latency operation
+  if (page_ntimes) {
+    if (page_ntimes < 0 || page_ntimes > padded_size) {
+      LOG_ERROR("Error: Illegal NTIMES '%i' for PADDED_SIZE '%i'\n", page_ntimes, padded_size);
+      exit(EXIT_FAILURE);
+    }
+    ntimes = page_ntimes;
+  }
+
 
   LOG("dadafilterbank version: " VERSION "\n");
   LOG("Science case = %i\n", science_case);
+  LOG("Time samples per page = %i\n", ntimes);
+  if (chunk_times) {
+    LOG("Low latency: writing chunks of %i time samples\n", chunk_times);
+  }
   LOG("Filename prefix = %s\n", file_prefix);
 
   if (science_mode == 0) {
@@ -322,64 +1190,102 @@ int main (int argc, char *argv[]) {
     ntabs = 1;
     LOG("Science mode: 2 [I + IAB]\n");
   } else if (science_mode == 1 || science_mode == 3) {
-    LOG("Error: modes 1 [IQUV + TAB] / 3 [IQUV + IAB] not supported");
+    LOG_ERROR("Error: modes 1 [IQUV + TAB] / 3 [IQUV + IAB] not supported");
     exit(EXIT_FAILURE);
   } else {
-    LOG("Error: Illegal science mode '%i'", science_mode);
+    LOG_ERROR("Error: Illegal science mode '%i'", science_mode);
     exit(EXIT_FAILURE);
   }
 
+  if (interleave_beams) {
+    LOG("Output layout: single file [time, beam, channel]\n");
+  } else {
+    LOG("Output layout: file per beam [time, channel]\n");
+  }
+  if (ascending_frequency) {
+    LOG("Frequency order: ascending\n");
+  } else {
+    LOG("Frequency order: descending\n");
+  }
+
+  if (checksums) {
+    crc32c_init();
+    if (interleave_beams) {
+      crc32c_stripes_init(&crc_stripes, ntabs, nchannels);
+    }
+    LOG("Writing checksum manifests\n");
+  }
+
+  start_pool();
+
   // create filterbank files, and close files on C-c
   open_files(file_prefix, ntabs);
-  signal(SIGINT, sigint_handler);
+  if (stats_interval) {
+    LOG("Writing statistics every %i pages\n", stats_interval);
+    open_stats(file_prefix);
+  }
+
+  // no SA_RESTART, so a blocking read from the ringbuffer is interrupted
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = sigint_handler;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+
+  if (raw_directory) {
+    int npages = convert_raw_pages(raw_directory);
+    close_manifests();
+    sync_files();
+    close_files();
+    pool_destroy(pool);
+    if (npages < 0) {
+      exit(EXIT_FAILURE);
+    }
+    LOG("Converted %i pages\n", npages);
+    exit(EXIT_SUCCESS);
+  }
+
+  ipcbuf_t *data_block = (ipcbuf_t *) ringbuffer->data_block;
+  ipcio_t *ipc = ringbuffer->data_block;
 
   // for interaction with ringbuffer
   uint64_t bufsz = ipc->curbufsz;
   char *page = NULL;
 
   // for processing a page
-  int tab, channel, time;
   char *buffer = malloc(ntabs * ntimes * nchannels * sizeof(char));
 
   int page_count = 0;
   int quit = 0;
-  while(!quit && !ipcbuf_eod(data_block)) {
+  int failed = 0;
+  while(!quit && !interrupted && !ipcbuf_eod(data_block)) {
 
     page = ipcbuf_get_next_read(data_block, &bufsz);
     if (! page) {
       quit = 1;
     } else {
-      // page [NTABS, nchannels, time(padded_size)]
-      // file [time, nchannels]
-      for (tab = 0; tab < ntabs; tab++) {
-
-        int channel;
-#pragma omp parallel for
-        for (channel = 0; channel < nchannels; channel+=6) {
-          const char *channelA = &page[(tab*nchannels + channel + 0)*padded_size];
-          const char *channelB = &page[(tab*nchannels + channel + 1)*padded_size];
-          const char *channelC = &page[(tab*nchannels + channel + 2)*padded_size];
-          const char *channelD = &page[(tab*nchannels + channel + 3)*padded_size];
-          const char *channelE = &page[(tab*nchannels + channel + 4)*padded_size];
-          const char *channelF = &page[(tab*nchannels + channel + 5)*padded_size];
-
-          int time;
-          for (time = 0; time < ntimes; time++) {
-
-            // reverse freq order to comply with header
-            buffer[tab*ntimes*nchannels + time*nchannels+nchannels-(channel+0)-1] = channelA[time];
-            buffer[tab*ntimes*nchannels + time*nchannels+nchannels-(channel+1)-1] = channelB[time];
-            buffer[tab*ntimes*nchannels + time*nchannels+nchannels-(channel+2)-1] = channelC[time];
-            buffer[tab*ntimes*nchannels + time*nchannels+nchannels-(channel+3)-1] = channelD[time];
-            buffer[tab*ntimes*nchannels + time*nchannels+nchannels-(channel+4)-1] = channelE[time];
-            buffer[tab*ntimes*nchannels + time*nchannels+nchannels-(channel+5)-1] = channelF[time];
-          }
-        }
-        ssize_t size = write(output[tab], &buffer[tab*ntimes*nchannels], sizeof(char) * ntimes * nchannels);
+      if (process_page(page, buffer, page_count)) {
+        failed = 1;
+        quit = 1;
       }
       ipcbuf_mark_cleared((ipcbuf_t *) ipc);
       page_count++;
+
+      if (stats && page_count % stats_interval == 0) {
+        write_stats(page_count);
+      }
+    }
+  }
+
+  if (interrupted || failed) {
+    if (stats) {
+      close_stats(page_count);
     }
+    close_manifests();
+    sync_files();
+    close_files();
+    LOG("Read %i pages\n", page_count);
+    exit(EXIT_FAILURE);
   }
 
   if (ipcbuf_eod(data_block)) {
@@ -388,6 +1294,12 @@ int main (int argc, char *argv[]) {
 
   dada_hdu_unlock_read(ringbuffer);
   dada_hdu_disconnect(ringbuffer);
+  if (stats) {
+    close_stats(page_count);
+  }
+  close_manifests();
+  close_files();
+  pool_destroy(pool);
   free(buffer);
   LOG("Read %i pages\n", page_count);
 }
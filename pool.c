@@ -0,0 +1,182 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include "pool.h"
+
+typedef struct {
+  pool_t *pool;
+  int worker;
+} pool_worker_t;
+
+/**
+ * Pin a thread to a single core, returns 0 on success or an error number
+ */
+static int pin_thread(pthread_t thread, int core) {
+  if (core < 0 || core >= CPU_SETSIZE) {
+    return EINVAL;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+  return pthread_setaffinity_np(thread, sizeof(cpu_set_t), &set);
+}
+
+/**
+ * Take tasks until none are left; tasks are handed out one at a time,
+ * so faster workers automatically take more tasks
+ */
+static void run_tasks(pool_t *pool, int worker) {
+  int task;
+  while ((task = atomic_fetch_add(&pool->next_task, 1)) < pool->ntasks) {
+    pool->task(pool->arg, task, worker);
+  }
+}
+
+static void *worker_main(void *arg) {
+  pool_worker_t *self = (pool_worker_t *) arg;
+  pool_t *pool = self->pool;
+  const int worker = self->worker;
+  free(self);
+
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    // sleep until there is a run this worker takes part in
+    while (!pool->stop && (pool->generation == seen || worker >= pool->nactive)) {
+      seen = pool->generation;
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->stop) {
+      break;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    run_tasks(pool, worker);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->pending == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+/**
+ * Start the worker threads, all workers are active initially
+ *
+ * @param {int} nworkers Number of workers, including the calling thread
+ * @param {const int *} cores Core for every worker to be pinned to, or NULL to not pin the threads
+ * @param {int *} failed_core Set to the core that a worker could not be pinned to
+ * @returns {pool_t *} Pool, stop with pool_destroy; NULL when pinning a worker failed
+ */
+pool_t *pool_create(int nworkers, const int *cores, int *failed_core) {
+  pool_t *pool = calloc(1, sizeof(pool_t));
+  pool->nworkers = nworkers;
+  pool->nactive = nworkers;
+  pool->threads = calloc(nworkers, sizeof(pthread_t));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  pool->threads[0] = pthread_self();
+  if (cores && pin_thread(pool->threads[0], cores[0])) {
+    *failed_core = cores[0];
+    pool->nworkers = 1;
+    pool_destroy(pool);
+    return NULL;
+  }
+
+  // SIGINT should be handled by the main thread
+  sigset_t mask, old;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &mask, &old);
+
+  int worker;
+  for (worker = 1; worker < nworkers; worker++) {
+    pool_worker_t *self = malloc(sizeof(pool_worker_t));
+    self->pool = pool;
+    self->worker = worker;
+    pthread_create(&pool->threads[worker], NULL, worker_main, self);
+    if (cores && pin_thread(pool->threads[worker], cores[worker])) {
+      // stop the workers started so far
+      *failed_core = cores[worker];
+      pthread_sigmask(SIG_SETMASK, &old, NULL);
+      pool->nworkers = worker + 1;
+      pool_destroy(pool);
+      return NULL;
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return pool;
+}
+
+void pool_destroy(pool_t *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  int worker;
+  for (worker = 1; worker < pool->nworkers; worker++) {
+    pthread_join(pool->threads[worker], NULL);
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  free(pool->threads);
+  free(pool);
+}
+
+/**
+ * Set the number of workers taking part in the next runs, between 1 and nworkers
+ */
+void pool_set_active(pool_t *pool, int nactive) {
+  if (nactive < 1) {
+    nactive = 1;
+  }
+  if (nactive > pool->nworkers) {
+    nactive = pool->nworkers;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->nactive = nactive;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Run tasks 0 to ntasks - 1 on the active workers, and wait for them to finish
+ *
+ * @param {pool_t *} pool Pool
+ * @param {pool_task_t} task Callback to run for every task
+ * @param {void *} arg Argument passed to the callback
+ * @param {int} ntasks Number of tasks
+ */
+void pool_run(pool_t *pool, pool_task_t task, void *arg, int ntasks) {
+  pthread_mutex_lock(&pool->lock);
+  pool->task = task;
+  pool->arg = arg;
+  pool->ntasks = ntasks;
+  atomic_store(&pool->next_task, 0);
+  pool->pending = pool->nactive - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  run_tasks(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
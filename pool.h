@@ -0,0 +1,40 @@
+#ifndef __HAVE_POOL_H__
+#define __HAVE_POOL_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/**
+ * Persistent pool of worker threads
+ *
+ * The calling thread takes part in every run as worker 0.
+ * Only the first nactive workers take part in a run, the others sleep,
+ * so the number of threads can be changed between runs at no cost.
+ */
+
+// Task callback: process task 'task' on worker 'worker' (0 <= worker < nworkers)
+typedef void (*pool_task_t)(void *arg, int task, int worker);
+
+typedef struct {
+  int nworkers;
+  int nactive;
+  pthread_t *threads;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned long generation; // incremented for every run
+  int pending;              // workers still busy with the current run
+  int stop;
+
+  pool_task_t task;
+  void *arg;
+  int ntasks;
+  atomic_int next_task;
+} pool_t;
+
+extern pool_t *pool_create(int nworkers, const int *cores, int *failed_core);
+extern void pool_destroy(pool_t *pool);
+extern void pool_set_active(pool_t *pool, int nactive);
+extern void pool_run(pool_t *pool, pool_task_t task, void *arg, int ntasks);
+#endif
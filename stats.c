@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+
+static void stats_reset(stats_t *stats) {
+  int beam;
+  for (beam = 0; beam < stats->nworkers * stats->ntabs; beam++) {
+    memset(stats->beams[beam].sum, 0, stats->nchannels * sizeof(uint64_t));
+    memset(stats->beams[beam].sumsq, 0, stats->nchannels * sizeof(uint64_t));
+    memset(stats->beams[beam].min, 255, stats->nchannels);
+    memset(stats->beams[beam].max, 0, stats->nchannels);
+  }
+
+  int i;
+  for (i = 0; i < stats->ntabs * stats->npages * stats->npower; i++) {
+    atomic_init(&stats->power[i], 0);
+  }
+}
+
+/**
+ * Allocate accumulators for per channel statistics and the total power time series
+ *
+ * @param {int} nworkers Number of threads that call stats_add concurrently
+ * @param {int} ntabs Number of tied array beams
+ * @param {int} nchannels Number of channels
+ * @param {int} ntimes Number of time samples per page
+ * @param {int} npages Number of pages per record
+ * @returns {stats_t *} Statistics, free with stats_destroy
+ */
+stats_t *stats_create(int nworkers, int ntabs, int nchannels, int ntimes, int npages) {
+  stats_t *stats = malloc(sizeof(stats_t));
+  stats->nworkers = nworkers;
+  stats->ntabs = ntabs;
+  stats->nchannels = nchannels;
+  stats->ntimes = ntimes;
+  stats->npages = npages;
+
+  // points should not cross page boundaries, so they all have the same length
+  stats->power_samples = ntimes < STATS_POWER_SAMPLES ? ntimes : STATS_POWER_SAMPLES;
+  while (ntimes % stats->power_samples) {
+    stats->power_samples--;
+  }
+  stats->npower = ntimes / stats->power_samples;
+
+  stats->beams = malloc(nworkers * ntabs * sizeof(stats_beam_t));
+  int beam;
+  for (beam = 0; beam < nworkers * ntabs; beam++) {
+    stats->beams[beam].sum = malloc(nchannels * sizeof(uint64_t));
+    stats->beams[beam].sumsq = malloc(nchannels * sizeof(uint64_t));
+    stats->beams[beam].min = malloc(nchannels);
+    stats->beams[beam].max = malloc(nchannels);
+  }
+  stats->power = malloc(ntabs * npages * stats->npower * sizeof(atomic_ullong));
+
+  stats_reset(stats);
+  return stats;
+}
+
+void stats_destroy(stats_t *stats) {
+  int beam;
+  for (beam = 0; beam < stats->nworkers * stats->ntabs; beam++) {
+    free(stats->beams[beam].sum);
+    free(stats->beams[beam].sumsq);
+    free(stats->beams[beam].min);
+    free(stats->beams[beam].max);
+  }
+  free(stats->beams);
+  free((void *) stats->power);
+  free(stats);
+}
+
+// Maximum number of rows reduced at once, so the 16 bit per channel sums cannot overflow
+#define STATS_ROWS 256
+
+// Number of channels reduced at once, the accumulators of a strip stay in registers
+#define STATS_STRIP 32
+
+/**
+ * Accumulate a strip of channels over at most STATS_ROWS rows
+ *
+ * Returns the sum over all samples in the strip
+ */
+static inline __attribute__((always_inline)) uint64_t stats_strip(
+    stats_beam_t *beam, const unsigned char *block, int channel, const int width, int nrows, int row_stride) {
+  uint16_t sum[STATS_STRIP] = {0};
+  uint32_t sumsq[STATS_STRIP] = {0};
+  unsigned char min[STATS_STRIP];
+  unsigned char max[STATS_STRIP];
+  int k;
+  for (k = 0; k < STATS_STRIP; k++) {
+    min[k] = 255;
+    max[k] = 0;
+  }
+
+  // simple element wise reductions over contiguous memory, these are vectorized by the compiler
+  int row;
+  for (row = 0; row < nrows; row++) {
+    const unsigned char *data = &block[row * row_stride + channel];
+    for (k = 0; k < width; k++) {
+      const uint16_t value = data[k];
+      sum[k] += value;
+      sumsq[k] += (uint16_t) (value * value);
+      min[k] = data[k] < min[k] ? data[k] : min[k];
+      max[k] = data[k] > max[k] ? data[k] : max[k];
+    }
+  }
+
+  uint64_t total = 0;
+  for (k = 0; k < width; k++) {
+    beam->sum[channel + k] += sum[k];
+    beam->sumsq[channel + k] += sumsq[k];
+    beam->min[channel + k] = min[k] < beam->min[channel + k] ? min[k] : beam->min[channel + k];
+    beam->max[channel + k] = max[k] > beam->max[channel + k] ? max[k] : beam->max[channel + k];
+    total += sum[k];
+  }
+  return total;
+}
+
+/**
+ * Accumulate statistics of a transposed block of time samples of one tied array beam
+ *
+ * Call this directly after transposing the block, while the output is still in cache.
+ * The reductions run along the channels of the block, in strips that fit in registers,
+ * so they vectorize independent of the length of the block.
+ * Different workers can process blocks of the same page concurrently.
+ *
+ * @param {stats_t *} stats Statistics
+ * @param {int} worker Index of the calling thread, less than nworkers
+ * @param {const char *} block Transposed block, the channels of sample time_start for this beam, in file order
+ * @param {int} tab Tied array beam
+ * @param {int} time_start First time sample of the block
+ * @param {int} time_end One past the last time sample of the block
+ * @param {int} row_stride Distance in bytes between consecutive time samples in the block
+ * @param {int} page_index Index of the page within the current record
+ */
+void stats_add(stats_t *stats, int worker, const char *block, int tab, int time_start, int time_end, int row_stride, int page_index) {
+  const int nchannels = stats->nchannels;
+  const unsigned char *rows = (const unsigned char *) block;
+  stats_beam_t *beam = &stats->beams[worker * stats->ntabs + tab];
+  atomic_ullong *power = &stats->power[(tab * stats->npages + page_index) * stats->npower];
+
+  // split the block on the boundaries of the total power time series
+  while (time_start < time_end) {
+    const int point = time_start / stats->power_samples;
+    int end = (point + 1) * stats->power_samples < time_end ? (point + 1) * stats->power_samples : time_end;
+    end = end - time_start > STATS_ROWS ? time_start + STATS_ROWS : end;
+
+    uint64_t total = 0;
+    int channel;
+    for (channel = 0; channel + STATS_STRIP <= nchannels; channel += STATS_STRIP) {
+      total += stats_strip(beam, rows, channel, STATS_STRIP, end - time_start, row_stride);
+    }
+    if (channel < nchannels) {
+      total += stats_strip(beam, rows, channel, nchannels - channel, end - time_start, row_stride);
+    }
+    atomic_fetch_add_explicit(&power[point], total, memory_order_relaxed);
+
+    rows += (end - time_start) * row_stride;
+    time_start = end;
+  }
+}
+
+/**
+ * Write a record with the statistics accumulated since the last record, and reset the accumulators
+ *
+ * Record layout, native byte order:
+ *
+ *    int32 first_page, npages, ntabs, nchannels, npower
+ *    double mjd               MJD of the first sample
+ *    double power_tsamp       time per point of the total power series (s)
+ *    per beam:
+ *      float mean[nchannels]
+ *      float variance[nchannels]
+ *      uint8 min[nchannels]
+ *      uint8 max[nchannels]
+ *      float power[npower]    mean sample value over all channels
+ *
+ * Channels are in the same order as in the filterbank files.
+ *
+ * @param {stats_t *} stats Statistics
+ * @param {FILE *} file Output file
+ * @param {int} first_page Index of the first page in this record
+ * @param {int} npages Number of pages accumulated, at most the pages per record
+ * @param {double} mjd Modified Julian Date of the first sample in this record
+ * @param {double} tsamp Sampling time (s)
+ */
+void stats_write(stats_t *stats, FILE *file, int first_page, int npages, double mjd, double tsamp) {
+  const int nchannels = stats->nchannels;
+  const int npower = npages * stats->npower;
+
+  int32_t counts[5] = {first_page, npages, stats->ntabs, nchannels, npower};
+  double times[2] = {mjd, tsamp * stats->power_samples};
+  fwrite(counts, sizeof(int32_t), 5, file);
+  fwrite(times, sizeof(double), 2, file);
+
+  float mean[nchannels];
+  float variance[nchannels];
+  unsigned char min[nchannels];
+  unsigned char max[nchannels];
+  float power[npower];
+  const double nsamples = (double) npages * stats->ntimes;
+
+  int tab;
+  for (tab = 0; tab < stats->ntabs; tab++) {
+    int channel;
+    for (channel = 0; channel < nchannels; channel++) {
+      uint64_t sum = 0;
+      uint64_t sumsq = 0;
+      unsigned char lo = 255;
+      unsigned char hi = 0;
+
+      int worker;
+      for (worker = 0; worker < stats->nworkers; worker++) {
+        stats_beam_t *beam = &stats->beams[worker * stats->ntabs + tab];
+        sum += beam->sum[channel];
+        sumsq += beam->sumsq[channel];
+        lo = beam->min[channel] < lo ? beam->min[channel] : lo;
+        hi = beam->max[channel] > hi ? beam->max[channel] : hi;
+      }
+
+      mean[channel] = sum / nsamples;
+      variance[channel] = sumsq / nsamples - (sum / nsamples) * (sum / nsamples);
+      min[channel] = lo;
+      max[channel] = hi;
+    }
+
+    int point;
+    for (point = 0; point < npower; point++) {
+      power[point] = atomic_load(&stats->power[tab * stats->npages * stats->npower + point]) / ((double) stats->power_samples * nchannels);
+    }
+
+    fwrite(mean, sizeof(float), nchannels, file);
+    fwrite(variance, sizeof(float), nchannels, file);
+    fwrite(min, 1, nchannels, file);
+    fwrite(max, 1, nchannels, file);
+    fwrite(power, sizeof(float), npower, file);
+  }
+  fflush(file);
+
+  stats_reset(stats);
+}
@@ -0,0 +1,37 @@
+#ifndef __HAVE_STATS_H__
+#define __HAVE_STATS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Maximum number of time samples per point of the total power time series,
+// the actual length is the largest divisor of the page length up to this value
+#define STATS_POWER_SAMPLES 1250
+
+// Accumulators for a single tied array beam, as used by a single worker
+typedef struct {
+  uint64_t *sum;       // [nchannels]
+  uint64_t *sumsq;     // [nchannels]
+  unsigned char *min;  // [nchannels]
+  unsigned char *max;  // [nchannels]
+} stats_beam_t;
+
+typedef struct {
+  int nworkers;
+  int ntabs;
+  int nchannels;
+  int ntimes;
+  int npages;          // pages per record
+  int npower;          // total power points per page
+  int power_samples;   // time samples per total power point
+
+  stats_beam_t *beams; // [nworkers, ntabs]
+  atomic_ullong *power; // [ntabs, npages * npower]
+} stats_t;
+
+extern stats_t *stats_create(int nworkers, int ntabs, int nchannels, int ntimes, int npages);
+extern void stats_destroy(stats_t *stats);
+extern void stats_add(stats_t *stats, int worker, const char *block, int tab, int time_start, int time_end, int row_stride, int page_index);
+extern void stats_write(stats_t *stats, FILE *file, int first_page, int npages, double mjd, double tsamp);
+#endif
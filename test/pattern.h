@@ -0,0 +1,41 @@
+#ifndef __HAVE_PATTERN_H__
+#define __HAVE_PATTERN_H__
+
+#include <stdint.h>
+
+/**
+ * Deterministic page contents for the tests
+ *
+ * Every sample is a hash of its page, beam, channel and time index,
+ * so a sample that ends up at any other position is detected.
+ */
+static inline unsigned char test_pattern(int page, int tab, int channel, int time) {
+  uint32_t h = (uint32_t) page * 0x9e3779b1u ^ (uint32_t) tab * 0x85ebca77u ^
+    (uint32_t) channel * 0xc2b2ae3du ^ (uint32_t) time * 0x27d4eb2fu;
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 12;
+  return h >> 24;
+}
+
+// Value of the padding after the last time sample of a channel, should never end up in the output
+#define TEST_PADDING 0x5a
+
+/**
+ * Fill a ringbuffer page [ntabs, nchannels, time(padded_size)]
+ */
+static inline void test_fill_page(char *page, int page_index, int ntabs, int nchannels, int ntimes, int padded_size) {
+  int tab, channel, time;
+  for (tab = 0; tab < ntabs; tab++) {
+    for (channel = 0; channel < nchannels; channel++) {
+      char *row = &page[((size_t) tab * nchannels + channel) * padded_size];
+      for (time = 0; time < ntimes; time++) {
+        row[time] = test_pattern(page_index, tab, channel, time);
+      }
+      for (time = ntimes; time < padded_size; time++) {
+        row[time] = TEST_PADDING;
+      }
+    }
+  }
+}
+#endif
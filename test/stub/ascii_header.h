@@ -0,0 +1,6 @@
+#ifndef __HAVE_ASCII_HEADER_H__
+#define __HAVE_ASCII_HEADER_H__
+
+// Stand-in for the psrdada header parser, see dada_hdu.h
+extern int ascii_header_get(const char *header, const char *keyword, const char *format, ...);
+#endif
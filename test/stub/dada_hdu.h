@@ -0,0 +1,42 @@
+#ifndef __HAVE_DADA_HDU_H__
+#define __HAVE_DADA_HDU_H__
+
+/**
+ * Stand-in for the psrdada ringbuffer, for testing without a running ringbuffer
+ *
+ * Only the part of the psrdada API used by dadafilterbank is provided.
+ * Instead of connecting to shared memory, the header is read from the file in $DADA_STUB_HEADER,
+ * followed by $DADA_STUB_PAGES generated pages (see test/pattern.h).
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct multilog multilog_t;
+
+typedef struct {
+  int eod;
+} ipcbuf_t;
+
+typedef struct {
+  ipcbuf_t buf;       // must be first, dadafilterbank casts an ipcio_t to an ipcbuf_t
+  uint64_t curbufsz;
+} ipcio_t;
+
+typedef struct {
+  multilog_t *log;
+  ipcio_t *data_block;
+  ipcbuf_t *header_block;
+} dada_hdu_t;
+
+extern dada_hdu_t *dada_hdu_create(multilog_t *log);
+extern void dada_hdu_set_key(dada_hdu_t *hdu, key_t key);
+extern int dada_hdu_connect(dada_hdu_t *hdu);
+extern int dada_hdu_disconnect(dada_hdu_t *hdu);
+extern int dada_hdu_lock_read(dada_hdu_t *hdu);
+extern int dada_hdu_unlock_read(dada_hdu_t *hdu);
+
+extern char *ipcbuf_get_next_read(ipcbuf_t *buf, uint64_t *bytes);
+extern int ipcbuf_mark_cleared(ipcbuf_t *buf);
+extern int ipcbuf_eod(ipcbuf_t *buf);
+#endif
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include "dada_hdu.h"
+#include "ascii_header.h"
+#include "../pattern.h"
+
+#define STUB_HEADER_SIZE 4096
+#define STUB_NCHANNELS 1536
+
+static char header[STUB_HEADER_SIZE];
+static int header_read = 0;
+
+static char *page = NULL;
+static int npages = 0;
+static int served = 0;
+static int ntabs, ntimes, padded_size;
+
+static ipcio_t data_block;
+static ipcbuf_t header_block;
+
+dada_hdu_t *dada_hdu_create(multilog_t *log) {
+  dada_hdu_t *hdu = calloc(1, sizeof(dada_hdu_t));
+  hdu->log = log;
+  hdu->data_block = &data_block;
+  hdu->header_block = &header_block;
+  return hdu;
+}
+
+void dada_hdu_set_key(dada_hdu_t *hdu, key_t key) {
+}
+
+/**
+ * Read the header and prepare the page buffer, the page layout follows from the header like in dadafilterbank
+ */
+int dada_hdu_connect(dada_hdu_t *hdu) {
+  const char *fname = getenv("DADA_STUB_HEADER");
+  const char *pages = getenv("DADA_STUB_PAGES");
+  FILE *file = fname ? fopen(fname, "r") : NULL;
+  if (! file || ! pages) {
+    fprintf(stderr, "dada stub: set DADA_STUB_HEADER to a header file and DADA_STUB_PAGES to the number of pages\n");
+    return -1;
+  }
+  size_t size = fread(header, 1, STUB_HEADER_SIZE - 1, file);
+  header[size] = '\0';
+  fclose(file);
+  npages = atoi(pages);
+
+  int science_case = 0, science_mode = 0;
+  ntimes = 12500;
+  if (ascii_header_get(header, "SCIENCE_CASE", "%i", &science_case) != 1 ||
+      ascii_header_get(header, "SCIENCE_MODE", "%i", &science_mode) != 1 ||
+      ascii_header_get(header, "PADDED_SIZE", "%i", &padded_size) != 1) {
+    fprintf(stderr, "dada stub: incomplete header %s\n", fname);
+    return -1;
+  }
+  ascii_header_get(header, "NTIMES", "%i", &ntimes);
+  ntabs = science_mode == 2 ? 1 : science_case == 3 ? 9 : 12;
+
+  data_block.curbufsz = (uint64_t) ntabs * STUB_NCHANNELS * padded_size;
+  page = malloc(data_block.curbufsz);
+  return page ? 0 : -1;
+}
+
+int dada_hdu_disconnect(dada_hdu_t *hdu) {
+  free(page);
+  page = NULL;
+  return 0;
+}
+
+int dada_hdu_lock_read(dada_hdu_t *hdu) {
+  return 0;
+}
+
+int dada_hdu_unlock_read(dada_hdu_t *hdu) {
+  return 0;
+}
+
+/**
+ * The header block serves the header once, the data block serves the next generated page
+ */
+char *ipcbuf_get_next_read(ipcbuf_t *buf, uint64_t *bytes) {
+  if (buf == &header_block) {
+    if (header_read) {
+      return NULL;
+    }
+    header_read = 1;
+    *bytes = STUB_HEADER_SIZE;
+    return header;
+  }
+
+  if (served == npages) {
+    data_block.buf.eod = 1;
+    *bytes = 0;
+    return NULL;
+  }
+  test_fill_page(page, served, ntabs, STUB_NCHANNELS, ntimes, padded_size);
+  served++;
+  *bytes = data_block.curbufsz;
+  return page;
+}
+
+int ipcbuf_mark_cleared(ipcbuf_t *buf) {
+  if (buf == &data_block.buf && served == npages) {
+    buf->eod = 1;
+  }
+  return 0;
+}
+
+int ipcbuf_eod(ipcbuf_t *buf) {
+  return buf->eod;
+}
+
+/**
+ * Find a keyword at the start of a line, followed by whitespace and the value
+ *
+ * Returns the number of values read, or -1 when the keyword is not found
+ */
+int ascii_header_get(const char *header, const char *keyword, const char *format, ...) {
+  const size_t length = strlen(keyword);
+  const char *line = header;
+  while (line && *line) {
+    if (strncmp(line, keyword, length) == 0 && isspace((unsigned char) line[length])) {
+      va_list args;
+      va_start(args, format);
+      int count = vsscanf(&line[length], format, args);
+      va_end(args);
+      return count;
+    }
+    line = strchr(line, '\n');
+    if (line) line++;
+  }
+  return -1;
+}
@@ -0,0 +1,614 @@
+/**
+ * End to end test of dadafilterbank
+ *
+ * Runs the program against the ringbuffer stand-in in test/stub (or on generated raw pages with -r),
+ * and bit-checks the filterbank headers and data, the checksum manifests and the statistics
+ * against the generated page contents (see pattern.h).
+ * The checks follow from the program options: -i, -a, -c and -s change the expected output.
+ *
+ * With -F, the size of the files written by the program is limited, so writing fails:
+ * the program should then exit with an error, and the manifests may only cover data that is in the files.
+ *
+ * With -b, the mean transpose time per page is read from the log and compared with a baseline file,
+ * the test fails when the throughput is less than half of the baseline; -B stores the throughput as the new baseline.
+ *
+ * usage: test_dadafilterbank -p <program> -w <work directory> [-n <pages>] [-T <NTIMES>] [-C <science case>] [-M <science mode>] [-r]
+ *                            [-F <bytes>] [-b <baseline file>] [-B] [-- <program options>]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "pattern.h"
+#include "checksum.h"
+
+#define NCHANNELS 1536
+#define HEADER_MAX 4096
+
+// Test parameters
+static char *program = NULL;
+static char *workdir = NULL;
+static int npages = 3;
+static int page_ntimes = 0;
+static int science_case = 4;
+static int science_mode = 0;
+static int raw = 0;
+static long size_limit = 0;
+static char *baseline_file = NULL;
+static int record_baseline = 0;
+
+// Program options that change the expected output
+static int interleave_beams = 0;
+static int ascending_frequency = 0;
+static int checksums = 0;
+static int stats_interval = 0;
+
+// Observation, as written to the header
+static const double min_frequency = 1219.70;
+static const double bandwidth = 300.0;
+static const double ra = 123.4;
+static const double dec = 45.6;
+static const double az_start = 10.0;
+static const double za_start = 20.0;
+static const double mjd_start = 58000.5;
+static const char *source_name = "B0329+54";
+static const double tsamp = 1.024 / 12500;
+
+// Derived layout
+static int ntabs, nfiles, ntimes, padded_size, row_size;
+
+static int failures = 0;
+
+#define FAIL(...) { fprintf(stderr, "FAIL: " __VA_ARGS__); failures++; }
+
+static void usage() {
+  fprintf(stderr, "usage: test_dadafilterbank -p <program> -w <work directory> [-n <pages>] [-T <NTIMES>] [-C <science case>] [-M <science mode>] [-r]\n"
+                  "                           [-F <bytes>] [-b <baseline file>] [-B] [-- <program options>]\n");
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * Write the psrdada header of the test observation
+ */
+static void write_header(const char *fname) {
+  FILE *file = fopen(fname, "w");
+  if (! file) {
+    FAIL("Cannot write header %s\n", fname);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(file, "MIN_FREQUENCY %.2f\nBW %.1f\nRA %.1f\nDEC %.1f\nSOURCE %s\nAZ_START %.1f\nZA_START %.1f\nMJD_START %.1f\n",
+      min_frequency, bandwidth, ra, dec, source_name, az_start, za_start, mjd_start);
+  fprintf(file, "SCIENCE_CASE %i\nSCIENCE_MODE %i\nPADDED_SIZE %i\n", science_case, science_mode, padded_size);
+  if (page_ntimes) {
+    fprintf(file, "NTIMES %i\n", page_ntimes);
+  }
+  fclose(file);
+}
+
+/**
+ * Write the raw pages, numbered from 7 without leading zeros, so numeric and alphabetic order differ
+ */
+static void write_raw_pages(const char *directory) {
+  char fname[1024];
+  const size_t page_size = (size_t) ntabs * NCHANNELS * padded_size;
+  char *page = malloc(page_size);
+
+  int p;
+  for (p = 0; p < npages; p++) {
+    test_fill_page(page, p, ntabs, NCHANNELS, ntimes, padded_size);
+    snprintf(fname, 1024, "%s/page_%i.raw", directory, p + 7);
+    FILE *file = fopen(fname, "w");
+    if (! file || fwrite(page, 1, page_size, file) != page_size) {
+      FAIL("Cannot write raw page %s\n", fname);
+      exit(EXIT_FAILURE);
+    }
+    fclose(file);
+  }
+  free(page);
+}
+
+static void output_name(char *fname, int file, const char *suffix) {
+  if (nfiles == 1) {
+    snprintf(fname, 1024, "%s/obs.fil%s", workdir, suffix);
+  } else {
+    snprintf(fname, 1024, "%s/obs_%02i.fil%s", workdir, file, suffix);
+  }
+}
+
+static void remove_outputs() {
+  char fname[1024];
+  int file;
+  for (file = 0; file < nfiles; file++) {
+    output_name(fname, file, "");
+    unlink(fname);
+    output_name(fname, file, ".manifest");
+    unlink(fname);
+  }
+  snprintf(fname, 1024, "%s/obs.stats", workdir);
+  unlink(fname);
+}
+
+/**
+ * Sigproc header as it should be written for a file, independent of filterbank.c
+ */
+static void put_string(char **pos, const char *string) {
+  int len = strlen(string);
+  memcpy(*pos, &len, sizeof(int));
+  memcpy(*pos + sizeof(int), string, len);
+  *pos += sizeof(int) + len;
+}
+
+static void put_int(char **pos, const char *name, int value) {
+  put_string(pos, name);
+  memcpy(*pos, &value, sizeof(int));
+  *pos += sizeof(int);
+}
+
+static void put_double(char **pos, const char *name, double value) {
+  put_string(pos, name);
+  memcpy(*pos, &value, sizeof(double));
+  *pos += sizeof(double);
+}
+
+static int expected_header(char *header, int file) {
+  char *pos = header;
+  put_string(&pos, "HEADER_START");
+  put_int(&pos, "telescope_id", 10);
+  put_int(&pos, "machine_id", 15);
+  put_int(&pos, "data_type", 1);
+  put_string(&pos, "source_name");
+  put_string(&pos, source_name);
+  put_int(&pos, "barycentric", 0);
+  put_int(&pos, "pulsarcentric", 0);
+  put_double(&pos, "az_start", az_start);
+  put_double(&pos, "za_start", za_start);
+  put_double(&pos, "src_raj", ra);
+  put_double(&pos, "src_dej", dec);
+  put_double(&pos, "tstart", mjd_start);
+  put_double(&pos, "tsamp", tsamp);
+  put_int(&pos, "nbits", 8);
+  put_double(&pos, "fch1", ascending_frequency ? min_frequency : min_frequency + bandwidth - (bandwidth / NCHANNELS));
+  put_double(&pos, "foff", ascending_frequency ? bandwidth / NCHANNELS : -1 * bandwidth / NCHANNELS);
+  put_int(&pos, "nchans", NCHANNELS);
+  put_int(&pos, "nbeams", ntabs);
+  put_int(&pos, "ibeam", file);
+  put_int(&pos, "nifs", 1);
+  put_string(&pos, "HEADER_END");
+  return pos - header;
+}
+
+/**
+ * Expected sample of a file at a time sample and position in the row
+ */
+static unsigned char expected_sample(int file, int time, int column) {
+  const int tab = interleave_beams ? column / NCHANNELS : file;
+  const int k = column % NCHANNELS;
+  const int channel = ascending_frequency ? k : NCHANNELS - k - 1;
+  return test_pattern(time / ntimes, tab, channel, time % ntimes);
+}
+
+static char *read_file(const char *fname, size_t *size) {
+  FILE *file = fopen(fname, "r");
+  if (! file) {
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *contents = malloc(*size + 1);
+  if (fread(contents, 1, *size, file) != *size) {
+    free(contents);
+    contents = NULL;
+  } else {
+    contents[*size] = '\0';
+  }
+  fclose(file);
+  return contents;
+}
+
+static void check_data(int file, const char *fname, const char *data, size_t size, int header_size) {
+  const size_t data_size = (size_t) npages * ntimes * row_size;
+  if (size_limit) {
+    // the file is cut off, the data that was written is checked through the manifest
+    if ((long) size > size_limit) {
+      FAIL("%s: size %zu, above the limit of %li\n", fname, size, size_limit);
+    }
+    return;
+  }
+  if (size != header_size + data_size) {
+    FAIL("%s: size %zu, expected %zu\n", fname, size, header_size + data_size);
+    return;
+  }
+
+  const unsigned char *samples = (const unsigned char *) &data[header_size];
+  int time;
+  for (time = 0; time < npages * ntimes; time++) {
+    int column;
+    for (column = 0; column < row_size; column++) {
+      if (samples[(size_t) time * row_size + column] != expected_sample(file, time, column)) {
+        FAIL("%s: wrong sample at time %i, column %i\n", fname, time, column);
+        return;
+      }
+    }
+  }
+}
+
+/**
+ * Every segment line should cover a page, and the file line all data; the CRCs are recalculated
+ *
+ * When the file is cut off (-F), only the pages that are completely in the file may have a segment,
+ * and there should be no file line.
+ */
+static void check_manifest(const char *fname, const char *data, size_t size, int header_size) {
+  char mname[1024];
+  snprintf(mname, 1024, "%s.manifest", fname);
+  FILE *manifest = fopen(mname, "r");
+  if (! manifest) {
+    FAIL("%s: missing\n", mname);
+    return;
+  }
+
+  const long long file_size = (long long) ntimes * row_size;
+  int segments = 0, files = 0;
+  char line[1024];
+  while (fgets(line, 1024, manifest)) {
+    int page;
+    long long offset, length;
+    unsigned int crc;
+    if (line[0] == '#') {
+      continue;
+    } else if (sscanf(line, "segment %i %lli %lli %x", &page, &offset, &length, &crc) == 4) {
+      if ((size_limit ? page < 0 || page >= npages : page != segments) || offset != header_size + page * file_size || length != file_size) {
+        FAIL("%s: wrong segment %s", mname, line);
+      } else if (offset + length > size) {
+        FAIL("%s: segment beyond the end of the file %s", mname, line);
+      } else if (crc != crc32c_update(0, &data[offset], length)) {
+        FAIL("%s: wrong checksum for %s", mname, line);
+      }
+      segments++;
+    } else if (sscanf(line, "file %lli %lli %x", &offset, &length, &crc) == 3) {
+      if (offset != header_size || length != npages * file_size || offset + length != size) {
+        FAIL("%s: wrong file line %s", mname, line);
+      } else if (crc != crc32c_update(0, &data[offset], length)) {
+        FAIL("%s: wrong checksum for %s", mname, line);
+      }
+      files++;
+    } else {
+      FAIL("%s: unexpected line %s", mname, line);
+    }
+  }
+  fclose(manifest);
+
+  const int complete = size == header_size + npages * file_size;
+  if (size_limit ? segments > (size - header_size) / file_size || files != complete : segments != npages || files != 1) {
+    FAIL("%s: %i segments and %i file lines\n", mname, segments, files);
+  }
+}
+
+/**
+ * Total power points are the largest divisor of the page length up to 1250 samples
+ */
+static int power_samples() {
+  int samples = ntimes < 1250 ? ntimes : 1250;
+  while (ntimes % samples) {
+    samples--;
+  }
+  return samples;
+}
+
+static int close_enough(double value, double expected) {
+  const double diff = value > expected ? value - expected : expected - value;
+  return diff <= 1e-6 * (expected > 1 ? expected : 1);
+}
+
+/**
+ * Check the statistics records for the beams in a file against its data
+ */
+static void check_stats(int file, const char *stats, size_t stats_size, const char *data, int header_size) {
+  const unsigned char *samples = (const unsigned char *) &data[header_size];
+  const int points = ntimes / power_samples();
+
+  size_t pos = 0;
+  int first = 0;
+  while (first < npages) {
+    const int count = npages - first < stats_interval ? npages - first : stats_interval;
+    const int npower = count * points;
+    const size_t record_size = 5 * sizeof(int32_t) + 2 * sizeof(double) +
+      (size_t) ntabs * (NCHANNELS * (2 * sizeof(float) + 2) + npower * sizeof(float));
+    if (pos + record_size > stats_size) {
+      FAIL("statistics: record for page %i missing\n", first);
+      return;
+    }
+
+    int32_t counts[5];
+    double times[2];
+    memcpy(counts, &stats[pos], sizeof(counts));
+    memcpy(times, &stats[pos + sizeof(counts)], sizeof(times));
+    if (counts[0] != first || counts[1] != count || counts[2] != ntabs || counts[3] != NCHANNELS || counts[4] != npower) {
+      FAIL("statistics: wrong counts %i %i %i %i %i in record for page %i\n", counts[0], counts[1], counts[2], counts[3], counts[4], first);
+      return;
+    }
+    if (times[0] != mjd_start + first * ntimes * tsamp / 86400.0 || times[1] != tsamp * power_samples()) {
+      FAIL("statistics: wrong mjd %f or power_tsamp %f in record for page %i\n", times[0], times[1], first);
+    }
+
+    int tab;
+    for (tab = 0; tab < ntabs; tab++) {
+      const char *beam = &stats[pos + sizeof(counts) + sizeof(times) +
+        (size_t) tab * (NCHANNELS * (2 * sizeof(float) + 2) + npower * sizeof(float))];
+      if (! interleave_beams && tab != file) {
+        continue;
+      }
+      const int column_start = interleave_beams ? tab * NCHANNELS : 0;
+
+      int k;
+      for (k = 0; k < NCHANNELS; k++) {
+        uint64_t sum = 0, sumsq = 0;
+        unsigned char lo = 255, hi = 0;
+        int time;
+        for (time = first * ntimes; time < (first + count) * ntimes; time++) {
+          const unsigned char value = samples[(size_t) time * row_size + column_start + k];
+          sum += value;
+          sumsq += value * value;
+          lo = value < lo ? value : lo;
+          hi = value > hi ? value : hi;
+        }
+        const double n = (double) count * ntimes;
+        float mean, variance;
+        memcpy(&mean, &beam[k * sizeof(float)], sizeof(float));
+        memcpy(&variance, &beam[(NCHANNELS + k) * sizeof(float)], sizeof(float));
+        const unsigned char min = beam[2 * NCHANNELS * sizeof(float) + k];
+        const unsigned char max = beam[2 * NCHANNELS * sizeof(float) + NCHANNELS + k];
+        if (! close_enough(mean, (float) (sum / n)) || ! close_enough(variance, (float) (sumsq / n - (sum / n) * (sum / n))) || min != lo || max != hi) {
+          FAIL("statistics: wrong values for beam %i channel %i in record for page %i\n", tab, k, first);
+          return;
+        }
+      }
+
+      const int samples_per_point = power_samples();
+      int point;
+      for (point = 0; point < npower; point++) {
+        uint64_t sum = 0;
+        int time;
+        for (time = first * ntimes + point * samples_per_point; time < first * ntimes + (point + 1) * samples_per_point; time++) {
+          for (k = 0; k < NCHANNELS; k++) {
+            sum += samples[(size_t) time * row_size + column_start + k];
+          }
+        }
+        float power;
+        memcpy(&power, &beam[2 * NCHANNELS * (sizeof(float) + 1) + point * sizeof(float)], sizeof(float));
+        if (! close_enough(power, (float) (sum / ((double) samples_per_point * NCHANNELS)))) {
+          FAIL("statistics: wrong power for beam %i point %i in record for page %i\n", tab, point, first);
+          return;
+        }
+      }
+    }
+
+    pos += record_size;
+    first += count;
+  }
+
+  if (pos != stats_size) {
+    FAIL("statistics: %zu bytes after the last record\n", stats_size - pos);
+  }
+}
+
+/**
+ * Mean transpose time per page from the debug log, in seconds
+ */
+static double page_time(const char *log) {
+  FILE *file = fopen(log, "r");
+  if (! file) {
+    return 0;
+  }
+  char line[1024];
+  double total = 0;
+  int count = 0;
+  while (fgets(line, 1024, file)) {
+    const char *parallel = strstr(line, "(parallel ");
+    double seconds;
+    if (strncmp(line, "Page time", 9) == 0 && parallel && sscanf(parallel, "(parallel %lf", &seconds) == 1) {
+      total += seconds;
+      count++;
+    }
+  }
+  fclose(file);
+  return count ? total / count : 0;
+}
+
+/**
+ * Compare the throughput with the entry '<test name> <MB/s>' in the baseline file, or store it
+ */
+static void check_throughput(const char *log) {
+  const double seconds = page_time(log);
+  if (seconds <= 0) {
+    FAIL("no page times in %s\n", log);
+    return;
+  }
+  const double throughput = (double) ntabs * NCHANNELS * ntimes / seconds / 1e6;
+  char *name = basename(strdup(workdir));
+
+  if (record_baseline) {
+    FILE *file = fopen(baseline_file, "w");
+    if (! file) {
+      FAIL("Cannot write baseline %s\n", baseline_file);
+      return;
+    }
+    fprintf(file, "%s %.1f\n", name, throughput);
+    fclose(file);
+    printf("Baseline %s: %.1f MB/s\n", name, throughput);
+    return;
+  }
+
+  FILE *file = fopen(baseline_file, "r");
+  char entry[256];
+  double baseline = 0, value;
+  while (file && fscanf(file, "%255s %lf", entry, &value) == 2) {
+    if (strcmp(entry, name) == 0) {
+      baseline = value;
+    }
+  }
+  if (file) {
+    fclose(file);
+  }
+  if (baseline <= 0) {
+    FAIL("no baseline for %s in %s\n", name, baseline_file);
+    return;
+  }
+
+  printf("Throughput %.1f MB/s, baseline %.1f MB/s (%+.1f%%)\n", throughput, baseline, 100.0 * (throughput - baseline) / baseline);
+  if (throughput < 0.5 * baseline) {
+    FAIL("throughput %.1f MB/s is less than half of the baseline %.1f MB/s\n", throughput, baseline);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int c;
+  while ((c = getopt(argc, argv, "p:w:n:T:C:M:rF:b:B")) != -1) {
+    switch (c) {
+      case 'p': program = optarg; break;
+      case 'w': workdir = optarg; break;
+      case 'n': npages = atoi(optarg); break;
+      case 'T': page_ntimes = atoi(optarg); break;
+      case 'C': science_case = atoi(optarg); break;
+      case 'M': science_mode = atoi(optarg); break;
+      case 'r': raw = 1; break;
+      case 'F': size_limit = atol(optarg); break;
+      case 'b': baseline_file = optarg; break;
+      case 'B': record_baseline = 1; break;
+      default: usage();
+    }
+  }
+  if (! program || ! workdir || npages < 1 || (record_baseline && ! baseline_file)) {
+    usage();
+  }
+
+  // the remaining arguments are passed on to the program
+  char options[1024] = "";
+  int arg;
+  for (arg = optind; arg < argc; arg++) {
+    if (strcmp(argv[arg], "-i") == 0) interleave_beams = 1;
+    if (strcmp(argv[arg], "-a") == 0) ascending_frequency = 1;
+    if (strcmp(argv[arg], "-c") == 0) checksums = 1;
+    if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) stats_interval = atoi(argv[arg + 1]);
+    strncat(options, " ", sizeof(options) - strlen(options) - 1);
+    strncat(options, argv[arg], sizeof(options) - strlen(options) - 1);
+  }
+  if (baseline_file) {
+    strncat(options, " -v", sizeof(options) - strlen(options) - 1);
+  }
+
+  ntabs = science_mode == 2 ? 1 : science_case == 3 ? 9 : 12;
+  nfiles = interleave_beams ? 1 : ntabs;
+  ntimes = page_ntimes ? page_ntimes : 12500;
+  padded_size = page_ntimes ? page_ntimes + 24 : 12544;
+  row_size = interleave_beams ? ntabs * NCHANNELS : NCHANNELS;
+
+  crc32c_init();
+  if (crc32c_update(0, "123456789", 9) != 0xe3069283) {
+    FAIL("crc32c check value\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // run the program
+  char fname[1024], command[4096];
+  mkdir(workdir, 0755);
+  remove_outputs();
+  if (raw) {
+    snprintf(fname, 1024, "%s/raw", workdir);
+    mkdir(fname, 0755);
+    write_raw_pages(fname);
+    snprintf(fname, 1024, "%s/raw/header", workdir);
+    write_header(fname);
+    snprintf(command, 4096, "%s -r %s/raw -l %s/log.txt -n %s/obs%s > %s/stdout.txt", program, workdir, workdir, workdir, options, workdir);
+  } else {
+    snprintf(fname, 1024, "%s/header", workdir);
+    write_header(fname);
+    setenv("DADA_STUB_HEADER", fname, 1);
+    snprintf(command, 64, "%i", npages);
+    setenv("DADA_STUB_PAGES", command, 1);
+    snprintf(command, 4096, "%s -k dada -l %s/log.txt -n %s/obs%s > %s/stdout.txt", program, workdir, workdir, options, workdir);
+  }
+  printf("%s\n", command);
+  if (size_limit) {
+    // writes beyond the limit fail with EFBIG, instead of killing the program
+    struct rlimit limit = {size_limit, size_limit};
+    signal(SIGXFSZ, SIG_IGN);
+    if (setrlimit(RLIMIT_FSIZE, &limit)) {
+      FAIL("Cannot limit the file size\n");
+      exit(EXIT_FAILURE);
+    }
+    if (system(command) == 0) {
+      FAIL("%s: succeeded, but the files could not be written\n", command);
+    }
+  } else if (system(command) != 0) {
+    FAIL("%s\n", command);
+    exit(EXIT_FAILURE);
+  }
+
+  // check the output
+  size_t stats_size = 0;
+  char *stats = NULL;
+  if (stats_interval) {
+    snprintf(fname, 1024, "%s/obs.stats", workdir);
+    stats = read_file(fname, &stats_size);
+    if (! stats) {
+      FAIL("%s: missing\n", fname);
+    }
+  }
+
+  int file;
+  for (file = 0; file < nfiles; file++) {
+    output_name(fname, file, "");
+    size_t size;
+    char *data = read_file(fname, &size);
+    if (! data) {
+      FAIL("%s: missing\n", fname);
+      continue;
+    }
+
+    char header[HEADER_MAX];
+    const int header_size = expected_header(header, file);
+    if (size < header_size || memcmp(data, header, header_size) != 0) {
+      FAIL("%s: wrong header\n", fname);
+    } else {
+      check_data(file, fname, data, size, header_size);
+      if (checksums) {
+        check_manifest(fname, data, size, header_size);
+      }
+      if (stats) {
+        check_stats(file, stats, stats_size, data, header_size);
+      }
+    }
+    free(data);
+  }
+  free(stats);
+
+  if (size_limit) {
+    snprintf(fname, 1024, "%s/log.txt", workdir);
+    size_t log_size;
+    char *log = read_file(fname, &log_size);
+    if (! log || ! strstr(log, "ERROR")) {
+      FAIL("%s: write error not logged\n", fname);
+    }
+    free(log);
+  }
+
+  if (baseline_file) {
+    snprintf(fname, 1024, "%s/log.txt", workdir);
+    check_throughput(fname);
+  }
+
+  if (failures) {
+    exit(EXIT_FAILURE);
+  }
+
+  // the files are large, only keep them when the test fails
+  remove_outputs();
+  printf("OK\n");
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,63 @@
+#include "transpose.h"
+
+static inline __attribute__((always_inline)) void transpose_block_step(
+    const char *page, char *first, int tab, int nchannels, int time_start, int time_end, int padded_size, int time_stride, const int step) {
+  const int ntimes = time_end - time_start;
+
+  int channel;
+  for (channel = 0; channel < nchannels; channel+=6) {
+    const char *channelA = &page[(tab*nchannels + channel + 0)*padded_size + time_start];
+    const char *channelB = &page[(tab*nchannels + channel + 1)*padded_size + time_start];
+    const char *channelC = &page[(tab*nchannels + channel + 2)*padded_size + time_start];
+    const char *channelD = &page[(tab*nchannels + channel + 3)*padded_size + time_start];
+    const char *channelE = &page[(tab*nchannels + channel + 4)*padded_size + time_start];
+    const char *channelF = &page[(tab*nchannels + channel + 5)*padded_size + time_start];
+
+    char *dest = &first[step * channel];
+
+    int time;
+    for (time = 0; time < ntimes; time++) {
+      dest[time*time_stride + 0*step] = channelA[time];
+      dest[time*time_stride + 1*step] = channelB[time];
+      dest[time*time_stride + 2*step] = channelC[time];
+      dest[time*time_stride + 3*step] = channelD[time];
+      dest[time*time_stride + 4*step] = channelE[time];
+      dest[time*time_stride + 5*step] = channelF[time];
+    }
+  }
+}
+
+/**
+ * Transpose a range of time samples of a single tied array beam from a ringbuffer page to filterbank order
+ *
+ *    page [NTABS, nchannels, time(padded_size)]
+ *    out  [time, (beam,) nchannels]
+ *
+ * Consecutive time samples are written time_stride bytes apart,
+ * this allows writing directly into a [time, beam, channel] interleaved layout.
+ *
+ * Processing the page in blocks of time keeps the output in cache,
+ * so it can be checksummed etc. right after the transpose.
+ * See TRANSPOSE_BLOCK_SIZE for a sensible block length.
+ *
+ * The loop order and unrolling was selected with the code in the tune directory (loopct_r6),
+ * nchannels must be divisible by 6.
+ *
+ * @param {const char *} page Start of the ringbuffer page
+ * @param {char *} out Output position of the first channel of sample time_start for this beam
+ * @param {int} tab Tied array beam to transpose
+ * @param {int} nchannels Number of channels
+ * @param {int} time_start First time sample to transpose
+ * @param {int} time_end One past the last time sample to transpose
+ * @param {int} padded_size Length of the time dimension of the page
+ * @param {int} time_stride Distance in bytes between consecutive time samples in the output
+ * @param {int} reverse Reverse the frequency order, 1 for descending frequencies (negative foff)
+ */
+void transpose_block(const char *page, char *out, int tab, int nchannels, int time_start, int time_end, int padded_size, int time_stride, int reverse) {
+  // specialize for the direction of the channel axis
+  if (reverse) {
+    transpose_block_step(page, &out[nchannels - 1], tab, nchannels, time_start, time_end, padded_size, time_stride, -1);
+  } else {
+    transpose_block_step(page, out, tab, nchannels, time_start, time_end, padded_size, time_stride, 1);
+  }
+}
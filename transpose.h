@@ -0,0 +1,17 @@
+#ifndef __HAVE_TRANSPOSE_H__
+#define __HAVE_TRANSPOSE_H__
+
+// Target size in bytes of the output of a single block of a single beam, it should fit in the L2 cache
+#define TRANSPOSE_BLOCK_SIZE (128 * 1024)
+
+extern void transpose_block(
+    const char *page,
+    char *out,
+    int tab,
+    int nchannels,
+    int time_start,
+    int time_end,
+    int padded_size,
+    int time_stride,
+    int reverse);
+#endif
@@ -0,0 +1,63 @@
+#include <stddef.h>
+#include "../transpose.h"
+
+/*
+ * Input:   ntabs nchannels padded_size
+ * Output:  ntabs ntimes -nchannels    ; ntimes < padded_size
+ *
+ * The implementation used by dadafilterbank (see ../transpose.c):
+ * loopct_r6 on blocks of time samples that fit in cache, parallel over the blocks
+ *
+ * Unlike the other kernels every tab is kept, so all of them can be checked.
+ * The variants in the Makefile select the other output layouts of dadafilterbank:
+ *   INTERLEAVE  [time, tab, channel] as with the -i option
+ *   REVERSE     0 for ascending channels as with the -a option
+ *   CHUNK       transpose in chunks of this many samples as with the -L option,
+ *               so blocks do not start at multiples of the block length
+ */
+
+#ifndef INTERLEAVE
+#define INTERLEAVE 0
+#endif
+
+#ifndef REVERSE
+#define REVERSE 1
+#endif
+
+#ifndef CHUNK
+#define CHUNK 0
+#endif
+
+typedef struct {
+  int all_tabs;
+  int interleaved;
+  int reverse;
+} layout_t;
+
+const layout_t layout = {1, INTERLEAVE, REVERSE};
+
+void deinterleave(const char *page, char *transposed, const int ntabs, const int nchannels, const int ntimes, const int padded_size) {
+  const int block_times = TRANSPOSE_BLOCK_SIZE / nchannels > 0 ? TRANSPOSE_BLOCK_SIZE / nchannels : 1;
+  const int chunk_times = CHUNK > 0 ? CHUNK : ntimes;
+  const int row_size = INTERLEAVE ? ntabs * nchannels : nchannels;
+
+  int chunk_start;
+  for (chunk_start = 0; chunk_start < ntimes; chunk_start += chunk_times) {
+    const int chunk_end = chunk_start + chunk_times < ntimes ? chunk_start + chunk_times : ntimes;
+    const int nblocks = (chunk_end - chunk_start + block_times - 1) / block_times;
+
+    int tab;
+    for (tab = 0; tab < ntabs; tab++) {
+      char *out = INTERLEAVE ? &transposed[tab * nchannels] : &transposed[(size_t) tab * ntimes * nchannels];
+
+      int block;
+#pragma omp parallel for
+      for (block = 0; block < nblocks; block++) {
+        const int time_start = chunk_start + block * block_times;
+        const int time_end = time_start + block_times < chunk_end ? time_start + block_times : chunk_end;
+
+        transpose_block(page, &out[(size_t) time_start * row_size], tab, nchannels, time_start, time_end, padded_size, row_size, REVERSE);
+      }
+    }
+  }
+}
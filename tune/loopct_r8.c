@@ -11,7 +11,7 @@ void deinterleave(const char *page, char *transposed, const int ntabs, const int
 
     int channel;
 #pragma omp parallel for
-    for (channel = 0; channel < nchannels; channel+=6) {
+    for (channel = 0; channel < nchannels; channel+=8) {
       const char *channelA = &page[(tab*nchannels + channel + 0)*padded_size];
       const char *channelB = &page[(tab*nchannels + channel + 1)*padded_size];
       const char *channelC = &page[(tab*nchannels + channel + 2)*padded_size];
@@ -2,12 +2,105 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <libgen.h>
 #include <omp.h>
 #include <sys/mman.h>
 
+void deinterleave(const char *page, char *transposed, const int ntabs, const int nchannels, const int ntimes, const int padded_size);
+
+/*
+ * Output layout of the implementation, the default is that of the original kernels:
+ * [time, -nchannels] of the last tab only, as every tab overwrites the previous one.
+ * An implementation can override it with its own (strong) definition, see current.c
+ */
+typedef struct {
+  int all_tabs;     // every tab is kept, [tab, time, channel] or interleaved as [time, tab, channel]
+  int interleaved;
+  int reverse;      // channels in descending order
+} layout_t;
+
+const layout_t layout __attribute__((weak)) = {0, 0, 1};
+
+/*
+ * Deterministic page contents, each pattern encodes part of the tab, channel or time index.
+ * Together the patterns identify every input sample, so a misplaced sample
+ * (wrong channel, missing reversal, wrong time) fails at least one of them.
+ */
+#define NPATTERNS 4
+static char pattern(int p, int tab, int channel, int time) {
+  switch (p) {
+    case 0: return channel & 0xff;
+    case 1: return (channel >> 8) | (tab << 4);
+    case 2: return time & 0xff;
+    default: return time >> 8;
+  }
+}
+
+static void fill_page(char *page, int p, const int ntabs, const int nchannels, const int ntimes, const int padded_size) {
+  int tab, channel, time;
+  for (tab = 0; tab < ntabs; tab++) {
+    for (channel = 0; channel < nchannels; channel++) {
+      char *row = &page[(tab*nchannels + channel) * padded_size];
+      for (time = 0; time < ntimes; time++) {
+        row[time] = pattern(p, tab, channel, time);
+      }
+      // padding should never end up in the output
+      memset(&row[ntimes], 0x5a, padded_size - ntimes);
+    }
+  }
+}
+
+/*
+ * Compare every tab that should be in the output with the transpose of the input, see layout_t
+ */
+static int check_output(const char *transposed, int p, const int ntabs, const int nchannels, const int ntimes) {
+  int tab, channel, time;
+  for (tab = layout.all_tabs ? 0 : ntabs - 1; tab < ntabs; tab++) {
+    for (time = 0; time < ntimes; time++) {
+      const char *row;
+      if (! layout.all_tabs) {
+        row = &transposed[time * nchannels];
+      } else if (layout.interleaved) {
+        row = &transposed[(time * ntabs + tab) * nchannels];
+      } else {
+        row = &transposed[(tab * ntimes + time) * nchannels];
+      }
+
+      for (channel = 0; channel < nchannels; channel++) {
+        if (row[layout.reverse ? nchannels - channel - 1 : channel] != pattern(p, tab, channel, time)) {
+          fprintf(stderr, "Mismatch for pattern %i at tab %i, time %i, channel %i\n", p, tab, time, channel);
+          return 0;
+        }
+      }
+    }
+  }
+  return 1;
+}
+
+/*
+ * Look up the time for this implementation in a baseline file with lines '<name> <ms>'
+ */
+static double read_baseline(const char *fname, const char *name) {
+  FILE *baseline = fopen(fname, "r");
+  if (! baseline) {
+    return 0;
+  }
+
+  char entry[256];
+  double ms;
+  double found = 0;
+  while (fscanf(baseline, "%255s %lf", entry, &ms) == 2) {
+    if (strcmp(entry, name) == 0) {
+      found = ms;
+    }
+  }
+  fclose(baseline);
+  return found;
+}
+
 int main(int argc, char **argv) {
-  if (argc != 5) {
-    fprintf(stderr, "Need 4 arguments: ntabs, nchannels, ntimes, padded_size\n");
+  if (argc != 5 && argc != 6) {
+    fprintf(stderr, "Need 4 arguments: ntabs, nchannels, ntimes, padded_size [baseline file]\n");
     exit(EXIT_FAILURE);
   }
 
@@ -31,6 +124,16 @@ int main(int argc, char **argv) {
   mlock(page, mysize);
   mlock(transposed, mysize);
 
+  // bit-check the output for all patterns, the last pattern stays in the page for timing
+  int ok = 1;
+  int p;
+  for (p = 0; p < NPATTERNS; p++) {
+    fill_page(page, p, ntabs, nchannels, ntimes, padded_size);
+    memset(transposed, 0, mysize);
+    deinterleave(page, transposed, ntabs, nchannels, ntimes, padded_size);
+    ok &= check_output(transposed, p, ntabs, nchannels, ntimes);
+  }
+
   double start = omp_get_wtime();
 
   int i;
@@ -40,11 +143,20 @@ int main(int argc, char **argv) {
   }
 
   double end = omp_get_wtime();
+  double ms = (end - start)*1e3/10;
 
-  printf("%.6f ms\n", (end - start)*1e3/10);
+  printf("%.6f ms %s", ms, ok ? "OK" : "FAIL");
+
+  if (argc == 6) {
+    double baseline = read_baseline(argv[5], basename(argv[0]));
+    if (baseline > 0) {
+      printf(" %+.1f%%", 100.0 * (ms - baseline) / baseline);
+    }
+  }
+  printf("\n");
 
   free(page);
   free(transposed);
 
-  exit(EXIT_SUCCESS);
+  exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
 }